@@ -0,0 +1,775 @@
+#include "array.h"
+#include "stmt.h"
+#include "terp.h"
+#include "value.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#endif
+
+#define MASK_BYTES(n) (((n) + 7) / 8)
+
+static const int elementSize[] = {
+	[eINT32] = sizeof(int32_t),
+	[eINT64] = sizeof(int64_t),
+	[eREAL] = sizeof(double),
+	[eMASK] = 0
+};
+
+size_t dataSize(ElemType type, int length) {
+	return type == eMASK ? MASK_BYTES(length) : (size_t)length * elementSize[type];
+}
+
+Array *newArray(ElemType type, int length) {
+	Array *array = (Array *)malloc(sizeof(Array));
+
+	array->type = type;
+	array->length = length;
+	array->capacity = length;
+	array->marked = 0;
+
+	// masks are built by or-ing bits in, so they start out clear
+	if (type == eMASK)
+		array->data = calloc(dataSize(type, length) + 1, 1);
+	else
+		array->data = malloc(dataSize(type, length) + 1);
+
+	return array;
+}
+
+Array *copyArray(Array *array) {
+	Array *copy = newArray(array->type, array->length);
+
+	memcpy(copy->data, array->data, dataSize(array->type, array->length));
+	return copy;
+}
+
+void freeArray(Array *array) {
+	if (array == NULL)
+		return;
+
+	free(array->data);
+	free(array);
+}
+
+// element i of a non-mask array as a double
+static double realAt(Array *array, int i) {
+	switch(array->type) {
+	case eINT32:
+		return ((int32_t *)array->data)[i];
+	case eINT64:
+		return (double)((int64_t *)array->data)[i];
+	case eREAL:
+		return ((double *)array->data)[i];
+	default:
+		return MASK_BIT(array, i);
+	}
+}
+
+// what type of array a number needs at least
+static ElemType scalarType(Element e) {
+	if (e.type == tREAL || e.type == tBIG)
+		return eREAL;
+
+	return integerOf(e) == (int32_t)integerOf(e) ? eINT32 : eINT64;
+}
+
+void arrayAppend(Array *array, Element value) {
+	ElemType type = scalarType(value);
+	void *data;
+	int i;
+
+	// one real makes the whole literal real, one integer too big for 32 bits makes it 64 bit
+	if (type > array->type) {
+		data = malloc(dataSize(type, array->capacity + 1));
+
+		for (i = 0; i < array->length; i++) {
+			if (type == eREAL)
+				((double *)data)[i] = realAt(array, i);
+			else
+				((int64_t *)data)[i] = ((int32_t *)array->data)[i];
+		}
+
+		free(array->data);
+		array->data = data;
+		array->type = type;
+	}
+
+	if (array->length == array->capacity) {
+		array->capacity = array->capacity ? array->capacity * 2 : 8;
+		array->data = realloc(array->data, dataSize(array->type, array->capacity));
+	}
+
+	switch(array->type) {
+	case eINT32:
+		((int32_t *)array->data)[array->length++] = integerOf(value);
+		break;
+	case eINT64:
+		((int64_t *)array->data)[array->length++] = integerOf(value);
+		break;
+	default:
+		((double *)array->data)[array->length++] = realOf(value);
+		break;
+	}
+}
+
+/*
+ * Kernels. Each one combines n elements of a and b into out; arithmetic kernels write
+ * elements of the same type, comparison kernels or bits into a cleared mask. out may be a or b.
+ * Every kernel has a scalar version, the SIMD versions do whole vectors and leave the
+ * rest to it.
+ */
+
+typedef void (*Kernel)(void *out, const void *a, const void *b, int n);
+
+// integers are done unsigned so they wrap without undefined behaviour; arrayArithmetic() makes
+// sure none of its results do (see overflowChecks)
+#define ARITH_SCALAR(name, T, U, op) \
+	static void name(void *out, const void *a, const void *b, int n) { \
+		T *o = out; \
+		const T *x = a, *y = b; \
+		int i; \
+		for (i = 0; i < n; i++) \
+			o[i] = (T)((U)x[i] op (U)y[i]); \
+	}
+
+// divisors have already been checked for zero, -1 is the one that can overflow
+#define DIV_SCALAR(name, T, U) \
+	static void name(void *out, const void *a, const void *b, int n) { \
+		T *o = out; \
+		const T *x = a, *y = b; \
+		int i; \
+		for (i = 0; i < n; i++) \
+			o[i] = y[i] == -1 ? (T)(0 - (U)x[i]) : x[i] / y[i]; \
+	}
+
+#define COMPARE_SCALAR(name, T, op) \
+	static void name(void *out, const void *a, const void *b, int n) { \
+		uint8_t *m = out; \
+		const T *x = a, *y = b; \
+		int i; \
+		for (i = 0; i < n; i++) \
+			if (x[i] op y[i]) \
+				m[i >> 3] |= 1 << (i & 7); \
+	}
+
+// integer sums wrap too, the caller makes sure the total fits
+static int64_t sumInt64(const int64_t *x, int n) {
+	uint64_t sum = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		sum += (uint64_t)x[i];
+
+	return (int64_t)sum;
+}
+
+ARITH_SCALAR(addInt32, int32_t, uint32_t, +)
+ARITH_SCALAR(subInt32, int32_t, uint32_t, -)
+ARITH_SCALAR(multInt32, int32_t, uint32_t, *)
+DIV_SCALAR(divInt32, int32_t, uint32_t)
+ARITH_SCALAR(addInt64, int64_t, uint64_t, +)
+ARITH_SCALAR(subInt64, int64_t, uint64_t, -)
+ARITH_SCALAR(multInt64, int64_t, uint64_t, *)
+DIV_SCALAR(divInt64, int64_t, uint64_t)
+ARITH_SCALAR(addReal, double, double, +)
+ARITH_SCALAR(subReal, double, double, -)
+ARITH_SCALAR(multReal, double, double, *)
+ARITH_SCALAR(divReal, double, double, /)
+
+COMPARE_SCALAR(lessInt32, int32_t, <)
+COMPARE_SCALAR(greaterInt32, int32_t, >)
+COMPARE_SCALAR(equalInt32, int32_t, ==)
+COMPARE_SCALAR(lessInt64, int64_t, <)
+COMPARE_SCALAR(greaterInt64, int64_t, >)
+COMPARE_SCALAR(equalInt64, int64_t, ==)
+COMPARE_SCALAR(lessReal, double, <)
+COMPARE_SCALAR(greaterReal, double, >)
+COMPARE_SCALAR(equalReal, double, ==)
+
+/*
+ * Overflow checks. Integer results have to be exact, the same as scalar ones, so before an
+ * integer kernel runs one of these says whether any element of it would overflow. Sums and
+ * differences look at sign bits and 32 bit products are worked out in 64 bits, branch free so
+ * the compiler can vectorize them.
+ */
+
+typedef int (*OverflowCheck)(const void *a, const void *b, int n);
+
+#define OVERFLOW_CHECK(name, T, test) \
+	static int name(const void *a, const void *b, int n) { \
+		const T *x = a, *y = b; \
+		T over = 0; \
+		int i; \
+		for (i = 0; i < n; i++) \
+			over |= (test); \
+		return over != 0; \
+	}
+
+// x + y overflows when the result's sign differs from both of theirs, x - y when x and y have
+// different signs and the result's differs from x's
+#define ADD_OVERFLOWS(T, U) ((x[i] ^ (T)((U)x[i] + (U)y[i])) & (y[i] ^ (T)((U)x[i] + (U)y[i]))) < 0
+#define SUB_OVERFLOWS(T, U) ((x[i] ^ y[i]) & (x[i] ^ (T)((U)x[i] - (U)y[i]))) < 0
+
+OVERFLOW_CHECK(addOverflowsInt32, int32_t, ADD_OVERFLOWS(int32_t, uint32_t))
+OVERFLOW_CHECK(subOverflowsInt32, int32_t, SUB_OVERFLOWS(int32_t, uint32_t))
+OVERFLOW_CHECK(multOverflowsInt32, int32_t, (int64_t)x[i] * y[i] != (int32_t)((int64_t)x[i] * y[i]))
+OVERFLOW_CHECK(divOverflowsInt32, int32_t, x[i] == INT32_MIN && y[i] == -1)
+OVERFLOW_CHECK(addOverflowsInt64, int64_t, ADD_OVERFLOWS(int64_t, uint64_t))
+OVERFLOW_CHECK(subOverflowsInt64, int64_t, SUB_OVERFLOWS(int64_t, uint64_t))
+OVERFLOW_CHECK(divOverflowsInt64, int64_t, x[i] == INT64_MIN && y[i] == -1)
+
+static int multOverflowsInt64(const void *a, const void *b, int n) {
+	const int64_t *x = a, *y = b;
+	int64_t product;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (__builtin_mul_overflow(x[i], y[i], &product))
+			return 1;
+	}
+
+	return 0;
+}
+
+static OverflowCheck overflowChecks[eINT64 + 1][aMULT + 1] = {
+	[eINT32] = { [aPLUS] = addOverflowsInt32, [aSUB] = subOverflowsInt32, [aMULT] = multOverflowsInt32, [aDIV] = divOverflowsInt32 },
+	[eINT64] = { [aPLUS] = addOverflowsInt64, [aSUB] = subOverflowsInt64, [aMULT] = multOverflowsInt64, [aDIV] = divOverflowsInt64 }
+};
+
+// 64 bit results that don't all fit: each one worked out exactly and rounded to a double
+static Array *exactReals(ArithOp op, const int64_t *x, const int64_t *y, int n) {
+	Array *result = newArray(eREAL, n);
+	double *o = result->data;
+	__int128 exact;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		switch(op) {
+		case aPLUS:
+			exact = (__int128)x[i] + y[i];
+			break;
+		case aSUB:
+			exact = (__int128)x[i] - y[i];
+			break;
+		case aMULT:
+			exact = (__int128)x[i] * y[i];
+			break;
+		default:
+			exact = (__int128)x[i] / y[i];
+			break;
+		}
+
+		o[i] = (double)exact;
+	}
+
+	return result;
+}
+
+#ifdef __x86_64__
+
+/*
+ * SSE2 is part of x86-64, so these are always available
+ */
+
+#define ARITH_SSE2(name, T, V, load, store, vecop, scalar) \
+	static void name(void *out, const void *a, const void *b, int n) { \
+		T *o = out; \
+		const T *x = a, *y = b; \
+		int i = 0; \
+		for (; i + 16 / (int)sizeof(T) <= n; i += 16 / sizeof(T)) \
+			store((V *)(o + i), vecop(load((const V *)(x + i)), load((const V *)(y + i)))); \
+		scalar(o + i, x + i, y + i, n - i); \
+	}
+
+static int64_t sumInt64Sse2(const int64_t *x, int n) {
+	__m128i sum = _mm_setzero_si128();
+	int64_t lanes[2];
+	int i = 0;
+
+	for (; i + 2 <= n; i += 2)
+		sum = _mm_add_epi64(sum, _mm_loadu_si128((const __m128i *)(x + i)));
+
+	_mm_storeu_si128((__m128i *)lanes, sum);
+	return (int64_t)((uint64_t)lanes[0] + (uint64_t)lanes[1] + (uint64_t)sumInt64(x + i, n - i));
+}
+
+ARITH_SSE2(addInt32Sse2, int32_t, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi32, addInt32)
+ARITH_SSE2(subInt32Sse2, int32_t, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_sub_epi32, subInt32)
+ARITH_SSE2(addInt64Sse2, int64_t, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_add_epi64, addInt64)
+ARITH_SSE2(subInt64Sse2, int64_t, __m128i, _mm_loadu_si128, _mm_storeu_si128, _mm_sub_epi64, subInt64)
+ARITH_SSE2(addRealSse2, double, double, _mm_loadu_pd, _mm_storeu_pd, _mm_add_pd, addReal)
+ARITH_SSE2(subRealSse2, double, double, _mm_loadu_pd, _mm_storeu_pd, _mm_sub_pd, subReal)
+ARITH_SSE2(multRealSse2, double, double, _mm_loadu_pd, _mm_storeu_pd, _mm_mul_pd, multReal)
+ARITH_SSE2(divRealSse2, double, double, _mm_loadu_pd, _mm_storeu_pd, _mm_div_pd, divReal)
+
+// overflow checks a vector at a time; signs picks the sign bit of each lane out of a byte mask
+#define OVERFLOW_SSE2(name, T, vecop, over, signs, scalar) \
+	static int name(const void *a, const void *b, int n) { \
+		const T *x = a, *y = b; \
+		__m128i X, Y, R, any = _mm_setzero_si128(); \
+		int i = 0; \
+		for (; i + 16 / (int)sizeof(T) <= n; i += 16 / sizeof(T)) { \
+			X = _mm_loadu_si128((const __m128i *)(x + i)); \
+			Y = _mm_loadu_si128((const __m128i *)(y + i)); \
+			R = vecop(X, Y); \
+			any = _mm_or_si128(any, over); \
+		} \
+		return (_mm_movemask_epi8(any) & (signs)) != 0 || scalar(x + i, y + i, n - i); \
+	}
+
+#define ADD_OVERFLOWS_SSE2 _mm_and_si128(_mm_xor_si128(X, R), _mm_xor_si128(Y, R))
+#define SUB_OVERFLOWS_SSE2 _mm_and_si128(_mm_xor_si128(X, Y), _mm_xor_si128(X, R))
+
+OVERFLOW_SSE2(addOverflowsInt32Sse2, int32_t, _mm_add_epi32, ADD_OVERFLOWS_SSE2, 0x8888, addOverflowsInt32)
+OVERFLOW_SSE2(subOverflowsInt32Sse2, int32_t, _mm_sub_epi32, SUB_OVERFLOWS_SSE2, 0x8888, subOverflowsInt32)
+OVERFLOW_SSE2(addOverflowsInt64Sse2, int64_t, _mm_add_epi64, ADD_OVERFLOWS_SSE2, 0x8080, addOverflowsInt64)
+OVERFLOW_SSE2(subOverflowsInt64Sse2, int64_t, _mm_sub_epi64, SUB_OVERFLOWS_SSE2, 0x8080, subOverflowsInt64)
+
+// 8 elements (one mask byte) per iteration: two vectors of 4 ints
+#define COMPARE_INT32_SSE2(name, cmp, scalar) \
+	static void name(void *out, const void *a, const void *b, int n) { \
+		uint8_t *m = out; \
+		const int32_t *x = a, *y = b; \
+		__m128i X, Y; \
+		int i = 0, low, high; \
+		for (; i + 8 <= n; i += 8) { \
+			X = _mm_loadu_si128((const __m128i *)(x + i)); \
+			Y = _mm_loadu_si128((const __m128i *)(y + i)); \
+			low = _mm_movemask_ps(_mm_castsi128_ps(cmp)); \
+			X = _mm_loadu_si128((const __m128i *)(x + i + 4)); \
+			Y = _mm_loadu_si128((const __m128i *)(y + i + 4)); \
+			high = _mm_movemask_ps(_mm_castsi128_ps(cmp)); \
+			m[i >> 3] = (uint8_t)(low | high << 4); \
+		} \
+		scalar(m + (i >> 3), x + i, y + i, n - i); \
+	}
+
+COMPARE_INT32_SSE2(lessInt32Sse2, _mm_cmplt_epi32(X, Y), lessInt32)
+COMPARE_INT32_SSE2(greaterInt32Sse2, _mm_cmpgt_epi32(X, Y), greaterInt32)
+COMPARE_INT32_SSE2(equalInt32Sse2, _mm_cmpeq_epi32(X, Y), equalInt32)
+
+// four vectors of 2 doubles
+#define COMPARE_REAL_SSE2(name, cmp, scalar) \
+	static void name(void *out, const void *a, const void *b, int n) { \
+		uint8_t *m = out; \
+		const double *x = a, *y = b; \
+		int i = 0, j, bits; \
+		for (; i + 8 <= n; i += 8) { \
+			for (bits = 0, j = 0; j < 8; j += 2) \
+				bits |= _mm_movemask_pd(cmp(_mm_loadu_pd(x + i + j), _mm_loadu_pd(y + i + j))) << j; \
+			m[i >> 3] = (uint8_t)bits; \
+		} \
+		scalar(m + (i >> 3), x + i, y + i, n - i); \
+	}
+
+COMPARE_REAL_SSE2(lessRealSse2, _mm_cmplt_pd, lessReal)
+COMPARE_REAL_SSE2(greaterRealSse2, _mm_cmpgt_pd, greaterReal)
+COMPARE_REAL_SSE2(equalRealSse2, _mm_cmpeq_pd, equalReal)
+
+/*
+ * AVX2, only used if the CPU says it has it
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define ARITH_AVX2(name, T, V, load, store, vecop, scalar) \
+	AVX2 static void name(void *out, const void *a, const void *b, int n) { \
+		T *o = out; \
+		const T *x = a, *y = b; \
+		int i = 0; \
+		for (; i + 32 / (int)sizeof(T) <= n; i += 32 / sizeof(T)) \
+			store((V *)(o + i), vecop(load((const V *)(x + i)), load((const V *)(y + i)))); \
+		scalar(o + i, x + i, y + i, n - i); \
+	}
+
+AVX2 static int64_t sumInt64Avx2(const int64_t *x, int n) {
+	__m256i sum = _mm256_setzero_si256();
+	int64_t lanes[4];
+	int i = 0;
+
+	for (; i + 4 <= n; i += 4)
+		sum = _mm256_add_epi64(sum, _mm256_loadu_si256((const __m256i *)(x + i)));
+
+	_mm256_storeu_si256((__m256i *)lanes, sum);
+	return (int64_t)((uint64_t)lanes[0] + (uint64_t)lanes[1] + (uint64_t)lanes[2] + (uint64_t)lanes[3]
+		+ (uint64_t)sumInt64(x + i, n - i));
+}
+
+ARITH_AVX2(addInt32Avx2, int32_t, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi32, addInt32)
+ARITH_AVX2(subInt32Avx2, int32_t, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_sub_epi32, subInt32)
+ARITH_AVX2(multInt32Avx2, int32_t, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_mullo_epi32, multInt32)
+ARITH_AVX2(addInt64Avx2, int64_t, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_add_epi64, addInt64)
+ARITH_AVX2(subInt64Avx2, int64_t, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, _mm256_sub_epi64, subInt64)
+ARITH_AVX2(addRealAvx2, double, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_add_pd, addReal)
+ARITH_AVX2(subRealAvx2, double, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_sub_pd, subReal)
+ARITH_AVX2(multRealAvx2, double, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_mul_pd, multReal)
+ARITH_AVX2(divRealAvx2, double, double, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_div_pd, divReal)
+
+#define OVERFLOW_AVX2(name, T, vecop, over, signs, scalar) \
+	AVX2 static int name(const void *a, const void *b, int n) { \
+		const T *x = a, *y = b; \
+		__m256i X, Y, R, any = _mm256_setzero_si256(); \
+		int i = 0; \
+		for (; i + 32 / (int)sizeof(T) <= n; i += 32 / sizeof(T)) { \
+			X = _mm256_loadu_si256((const __m256i *)(x + i)); \
+			Y = _mm256_loadu_si256((const __m256i *)(y + i)); \
+			R = vecop(X, Y); \
+			any = _mm256_or_si256(any, over); \
+		} \
+		return ((unsigned)_mm256_movemask_epi8(any) & (signs)) != 0 || scalar(x + i, y + i, n - i); \
+	}
+
+#define ADD_OVERFLOWS_AVX2 _mm256_and_si256(_mm256_xor_si256(X, R), _mm256_xor_si256(Y, R))
+#define SUB_OVERFLOWS_AVX2 _mm256_and_si256(_mm256_xor_si256(X, Y), _mm256_xor_si256(X, R))
+
+OVERFLOW_AVX2(addOverflowsInt32Avx2, int32_t, _mm256_add_epi32, ADD_OVERFLOWS_AVX2, 0x88888888u, addOverflowsInt32)
+OVERFLOW_AVX2(subOverflowsInt32Avx2, int32_t, _mm256_sub_epi32, SUB_OVERFLOWS_AVX2, 0x88888888u, subOverflowsInt32)
+OVERFLOW_AVX2(addOverflowsInt64Avx2, int64_t, _mm256_add_epi64, ADD_OVERFLOWS_AVX2, 0x80808080u, addOverflowsInt64)
+OVERFLOW_AVX2(subOverflowsInt64Avx2, int64_t, _mm256_sub_epi64, SUB_OVERFLOWS_AVX2, 0x80808080u, subOverflowsInt64)
+
+// products of the even lanes and then the odd ones in 64 bits, which fit in 32 if adding 2^31
+// leaves their high halves clear
+AVX2 static int multOverflowsInt32Avx2(const void *a, const void *b, int n) {
+	const int32_t *x = a, *y = b;
+	const __m256i bias = _mm256_set1_epi64x(0x80000000);
+	__m256i X, Y, even, odd, any = _mm256_setzero_si256();
+	int i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		X = _mm256_loadu_si256((const __m256i *)(x + i));
+		Y = _mm256_loadu_si256((const __m256i *)(y + i));
+		even = _mm256_add_epi64(_mm256_mul_epi32(X, Y), bias);
+		odd = _mm256_add_epi64(_mm256_mul_epi32(_mm256_srli_epi64(X, 32), _mm256_srli_epi64(Y, 32)), bias);
+		any = _mm256_or_si256(any, _mm256_or_si256(_mm256_srli_epi64(even, 32), _mm256_srli_epi64(odd, 32)));
+	}
+
+	return !_mm256_testz_si256(any, any) || multOverflowsInt32(x + i, y + i, n - i);
+}
+
+// 8 ints, one mask byte, per iteration
+#define COMPARE_INT32_AVX2(name, cmp, scalar) \
+	AVX2 static void name(void *out, const void *a, const void *b, int n) { \
+		uint8_t *m = out; \
+		const int32_t *x = a, *y = b; \
+		__m256i X, Y; \
+		int i = 0; \
+		for (; i + 8 <= n; i += 8) { \
+			X = _mm256_loadu_si256((const __m256i *)(x + i)); \
+			Y = _mm256_loadu_si256((const __m256i *)(y + i)); \
+			m[i >> 3] = (uint8_t)_mm256_movemask_ps(_mm256_castsi256_ps(cmp)); \
+		} \
+		scalar(m + (i >> 3), x + i, y + i, n - i); \
+	}
+
+COMPARE_INT32_AVX2(lessInt32Avx2, _mm256_cmpgt_epi32(Y, X), lessInt32)
+COMPARE_INT32_AVX2(greaterInt32Avx2, _mm256_cmpgt_epi32(X, Y), greaterInt32)
+COMPARE_INT32_AVX2(equalInt32Avx2, _mm256_cmpeq_epi32(X, Y), equalInt32)
+
+// two vectors of 4 int64s
+#define COMPARE_INT64_AVX2(name, cmp, scalar) \
+	AVX2 static void name(void *out, const void *a, const void *b, int n) { \
+		uint8_t *m = out; \
+		const int64_t *x = a, *y = b; \
+		__m256i X, Y; \
+		int i = 0, low; \
+		for (; i + 8 <= n; i += 8) { \
+			X = _mm256_loadu_si256((const __m256i *)(x + i)); \
+			Y = _mm256_loadu_si256((const __m256i *)(y + i)); \
+			low = _mm256_movemask_pd(_mm256_castsi256_pd(cmp)); \
+			X = _mm256_loadu_si256((const __m256i *)(x + i + 4)); \
+			Y = _mm256_loadu_si256((const __m256i *)(y + i + 4)); \
+			m[i >> 3] = (uint8_t)(low | _mm256_movemask_pd(_mm256_castsi256_pd(cmp)) << 4); \
+		} \
+		scalar(m + (i >> 3), x + i, y + i, n - i); \
+	}
+
+COMPARE_INT64_AVX2(lessInt64Avx2, _mm256_cmpgt_epi64(Y, X), lessInt64)
+COMPARE_INT64_AVX2(greaterInt64Avx2, _mm256_cmpgt_epi64(X, Y), greaterInt64)
+COMPARE_INT64_AVX2(equalInt64Avx2, _mm256_cmpeq_epi64(X, Y), equalInt64)
+
+// two vectors of 4 doubles (ordered predicates, so NaN compares false like it does in C)
+#define COMPARE_REAL_AVX2(name, predicate, scalar) \
+	AVX2 static void name(void *out, const void *a, const void *b, int n) { \
+		uint8_t *m = out; \
+		const double *x = a, *y = b; \
+		int i = 0, low; \
+		for (; i + 8 <= n; i += 8) { \
+			low = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), predicate)); \
+			m[i >> 3] = (uint8_t)(low | _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(x + i + 4), \
+				_mm256_loadu_pd(y + i + 4), predicate)) << 4); \
+		} \
+		scalar(m + (i >> 3), x + i, y + i, n - i); \
+	}
+
+COMPARE_REAL_AVX2(lessRealAvx2, _CMP_LT_OQ, lessReal)
+COMPARE_REAL_AVX2(greaterRealAvx2, _CMP_GT_OQ, greaterReal)
+COMPARE_REAL_AVX2(equalRealAvx2, _CMP_EQ_OQ, equalReal)
+
+#endif
+
+// indexed by element type and then ArithOp / BoolOp (overflowChecks is too)
+static Kernel arithKernels[eREAL + 1][aMULT + 1] = {
+	[eINT32] = { [aPLUS] = addInt32, [aSUB] = subInt32, [aMULT] = multInt32, [aDIV] = divInt32 },
+	[eINT64] = { [aPLUS] = addInt64, [aSUB] = subInt64, [aMULT] = multInt64, [aDIV] = divInt64 },
+	[eREAL] = { [aPLUS] = addReal, [aSUB] = subReal, [aMULT] = multReal, [aDIV] = divReal }
+};
+
+static Kernel compareKernels[eREAL + 1][bEQUALTO + 1] = {
+	[eINT32] = { [bLESSTHAN] = lessInt32, [bGREATERTHAN] = greaterInt32, [bEQUALTO] = equalInt32 },
+	[eINT64] = { [bLESSTHAN] = lessInt64, [bGREATERTHAN] = greaterInt64, [bEQUALTO] = equalInt64 },
+	[eREAL] = { [bLESSTHAN] = lessReal, [bGREATERTHAN] = greaterReal, [bEQUALTO] = equalReal }
+};
+
+static int64_t (*sumKernel)(const int64_t *x, int n) = sumInt64;
+
+// Pick the best kernels this CPU runs. TERP_SIMD=scalar|sse2 caps the choice, to compare them.
+static void pickKernels(void) {
+	const char *limit;
+
+#ifdef __x86_64__
+	limit = getenv("TERP_SIMD");
+
+	if (limit != NULL && strcmp(limit, "scalar") == 0)
+		return;
+
+	arithKernels[eINT32][aPLUS] = addInt32Sse2;
+	arithKernels[eINT32][aSUB] = subInt32Sse2;
+	arithKernels[eINT64][aPLUS] = addInt64Sse2;
+	arithKernels[eINT64][aSUB] = subInt64Sse2;
+	arithKernels[eREAL][aPLUS] = addRealSse2;
+	arithKernels[eREAL][aSUB] = subRealSse2;
+	arithKernels[eREAL][aMULT] = multRealSse2;
+	arithKernels[eREAL][aDIV] = divRealSse2;
+	compareKernels[eINT32][bLESSTHAN] = lessInt32Sse2;
+	compareKernels[eINT32][bGREATERTHAN] = greaterInt32Sse2;
+	compareKernels[eINT32][bEQUALTO] = equalInt32Sse2;
+	compareKernels[eREAL][bLESSTHAN] = lessRealSse2;
+	compareKernels[eREAL][bGREATERTHAN] = greaterRealSse2;
+	compareKernels[eREAL][bEQUALTO] = equalRealSse2;
+	sumKernel = sumInt64Sse2;
+	overflowChecks[eINT32][aPLUS] = addOverflowsInt32Sse2;
+	overflowChecks[eINT32][aSUB] = subOverflowsInt32Sse2;
+	overflowChecks[eINT64][aPLUS] = addOverflowsInt64Sse2;
+	overflowChecks[eINT64][aSUB] = subOverflowsInt64Sse2;
+
+	if ((limit != NULL && strcmp(limit, "sse2") == 0) || !__builtin_cpu_supports("avx2"))
+		return;
+
+	arithKernels[eINT32][aPLUS] = addInt32Avx2;
+	arithKernels[eINT32][aSUB] = subInt32Avx2;
+	arithKernels[eINT32][aMULT] = multInt32Avx2;
+	arithKernels[eINT64][aPLUS] = addInt64Avx2;
+	arithKernels[eINT64][aSUB] = subInt64Avx2;
+	arithKernels[eREAL][aPLUS] = addRealAvx2;
+	arithKernels[eREAL][aSUB] = subRealAvx2;
+	arithKernels[eREAL][aMULT] = multRealAvx2;
+	arithKernels[eREAL][aDIV] = divRealAvx2;
+	compareKernels[eINT32][bLESSTHAN] = lessInt32Avx2;
+	compareKernels[eINT32][bGREATERTHAN] = greaterInt32Avx2;
+	compareKernels[eINT32][bEQUALTO] = equalInt32Avx2;
+	compareKernels[eINT64][bLESSTHAN] = lessInt64Avx2;
+	compareKernels[eINT64][bGREATERTHAN] = greaterInt64Avx2;
+	compareKernels[eINT64][bEQUALTO] = equalInt64Avx2;
+	compareKernels[eREAL][bLESSTHAN] = lessRealAvx2;
+	compareKernels[eREAL][bGREATERTHAN] = greaterRealAvx2;
+	compareKernels[eREAL][bEQUALTO] = equalRealAvx2;
+	sumKernel = sumInt64Avx2;
+	overflowChecks[eINT32][aPLUS] = addOverflowsInt32Avx2;
+	overflowChecks[eINT32][aSUB] = subOverflowsInt32Avx2;
+	overflowChecks[eINT32][aMULT] = multOverflowsInt32Avx2;
+	overflowChecks[eINT64][aPLUS] = addOverflowsInt64Avx2;
+	overflowChecks[eINT64][aSUB] = subOverflowsInt64Avx2;
+#endif
+}
+
+// the tables are shared by every State, so they're filled in once whichever thread gets here first
+static void initKernels(void) {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, pickKernels);
+}
+
+/*
+ * Operands
+ */
+
+// masks and booleans count as 32 bit integers, big integers as reals
+static ElemType operandType(Element e) {
+	if (e.type == tSET)
+		return e.value.array->type == eMASK ? eINT32 : e.value.array->type;
+
+	return scalarType(e);
+}
+
+// Get an operand's elements as type. Converted arrays go in a new *temp; a scalar is
+// broadcast into spare if there is one (an arithmetic kernel can overwrite it in place).
+static void *operandData(Element e, ElemType type, int length, void *spare, void **temp) {
+	Array *array = e.type == tSET ? e.value.array : NULL;
+	int32_t *ints;
+	int64_t *longs;
+	double *reals;
+	int i;
+
+	*temp = NULL;
+
+	if (array != NULL && array->type == type)
+		return array->data;
+
+	if (array == NULL && spare != NULL)
+		ints = spare;
+	else
+		ints = *temp = malloc(dataSize(type, length) + 1);
+
+	longs = (int64_t *)ints;
+	reals = (double *)ints;
+
+	switch(type) {
+	case eINT32:
+		for (i = 0; i < length; i++)
+			ints[i] = array == NULL ? integerOf(e) : MASK_BIT(array, i);
+		break;
+	case eINT64:
+		for (i = 0; i < length; i++)
+			longs[i] = array == NULL ? integerOf(e) : array->type == eINT32 ? ((int32_t *)array->data)[i] : MASK_BIT(array, i);
+		break;
+	default:
+		for (i = 0; i < length; i++)
+			reals[i] = array == NULL ? realOf(e) : realAt(array, i);
+		break;
+	}
+
+	return ints;
+}
+
+// Work out the element type and length of an operation, 0 if the operands don't go together
+static int operands(State *state, Element left, Element right, ElemType *type, int *length) {
+	ElemType a = operandType(left), b = operandType(right);
+
+	if (left.type == tSET && right.type == tSET && left.value.array->length != right.value.array->length) {
+		error(state, "Array lengths differ");
+		return 0;
+	}
+
+	*type = a > b ? a : b;
+	*length = left.type == tSET ? left.value.array->length : right.value.array->length;
+	return 1;
+}
+
+int hasZero(const void *data, ElemType type, int length) {
+	int i;
+
+	for (i = 0; i < length; i++) {
+		if (type == eINT32 ? ((int32_t *)data)[i] == 0 : type == eINT64 ? ((int64_t *)data)[i] == 0 : ((double *)data)[i] == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+void arrayKernel(ElemType type, ArithOp op, void *out, const void *a, const void *b, int n) {
+	initKernels();
+	arithKernels[type][op](out, a, b, n);
+}
+
+int64_t arraySum(const int64_t *data, int n) {
+	initKernels();
+	return sumKernel(data, n);
+}
+
+Element arrayArithmetic(State *state, ArithOp op, Element left, Element right) {
+	void *a, *b, *tempA, *tempB;
+	ElemType type;
+	Array *result, *wide;
+	int length;
+
+	// nil is contagious here too
+	if (left.type == tNIL || right.type == tNIL)
+		return NIL;
+
+	if (!operands(state, left, right, &type, &length))
+		return NIL;
+
+	initKernels();
+
+	while (1) {
+		// at most one side is a scalar, it can use the result's buffer
+		result = newArray(type, length);
+		a = operandData(left, type, length, result->data, &tempA);
+		b = operandData(right, type, length, result->data, &tempB);
+
+		if (op == aDIV && hasZero(b, type, length)) {
+			error(state, "Division by zero");
+			freeArray(result);
+			free(tempA);
+			free(tempB);
+			return NIL;
+		}
+
+		if (type == eREAL || !overflowChecks[type][op](a, b, length)) {
+			arithKernels[type][op](result->data, a, b, length);
+			break;
+		}
+
+		// 32 bit results that don't fit always do in 64 bits, 64 bit ones become reals (worked
+		// out before the result goes, a scalar operand may be in it)
+		if (type == eINT64) {
+			wide = exactReals(op, a, b, length);
+			freeArray(result);
+			result = wide;
+			break;
+		}
+
+		freeArray(result);
+		free(tempA);
+		free(tempB);
+		type = eINT64;
+	}
+
+	free(tempA);
+	free(tempB);
+
+	return keepValue(state, (Element){ tSET, { .array = result } });
+}
+
+Element arrayCompare(State *state, BoolOp op, Element left, Element right) {
+	void *a, *b, *tempA, *tempB;
+	ElemType type;
+	Array *result;
+	int length;
+
+	if (left.type == tNIL || right.type == tNIL)
+		return NIL;
+
+	if (!operands(state, left, right, &type, &length))
+		return NIL;
+
+	initKernels();
+
+	a = operandData(left, type, length, NULL, &tempA);
+	b = operandData(right, type, length, NULL, &tempB);
+
+	result = newArray(eMASK, length);
+	compareKernels[type][op](result->data, a, b, length);
+
+	free(tempA);
+	free(tempB);
+
+	return keepValue(state, (Element){ tSET, { .array = result } });
+}
+
+int arrayAll(Array *array) {
+	int i;
+
+	for (i = 0; i < array->length; i++) {
+		if (array->type == eMASK ? !MASK_BIT(array, i) : realAt(array, i) == 0)
+			return 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,69 @@
+#ifndef __ARRAY_H__
+#define __ARRAY_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// what an array holds; every element of an array has the same type
+typedef enum tagElemType {
+	eINT32,
+	eINT64,
+	eREAL,
+
+	// one bit per element, what comparing arrays gives
+	eMASK
+} ElemType;
+
+// A tSET value: elements stored contiguously, so operators can run over them with SIMD
+typedef struct tagArray {
+	ElemType type;
+	int length;
+
+	// elements allocated (literals grow while they're parsed)
+	int capacity;
+
+	// set while collectGarbage() is looking for values still in use
+	int marked;
+
+	// int32_t, int64_t or double elements, or for masks bit i of byte i / 8
+	void *data;
+} Array;
+
+#define MASK_BIT(array, i) ((((uint8_t *)(array)->data)[(i) >> 3] >> ((i) & 7)) & 1)
+
+Array *newArray(ElemType type, int length);
+Array *copyArray(Array *array);
+void freeArray(Array *array);
+
+// bytes used by length elements of type
+size_t dataSize(ElemType type, int length);
+
+// Add a number to the end of an array literal (an integer added to a real array is converted,
+// a real added to an integer array converts the whole array, as does a 64 bit integer added
+// to a 32 bit one)
+void arrayAppend(Array *array, Element value);
+
+// Apply an operator elementwise. One side may be a scalar, which is used for every element;
+// arrays must have the same length. Comparisons give masks. Integer results are exact: a 32 bit
+// array whose results don't all fit gives a 64 bit one, and a 64 bit one gives reals.
+Element arrayArithmetic(State *state, ArithOp op, Element left, Element right);
+Element arrayCompare(State *state, BoolOp op, Element left, Element right);
+
+// Run op's kernel over n elements of a and b (which are of type) into out. Unlike
+// arrayArithmetic(), integers wrap: the caller makes sure they can't overflow, and that no
+// divisor is zero.
+void arrayKernel(ElemType type, ArithOp op, void *out, const void *a, const void *b, int n);
+
+// The sum of n integers, wrapping like the kernels do
+int64_t arraySum(const int64_t *data, int n);
+
+// Whether any of length elements of type is zero
+int hasZero(const void *data, ElemType type, int length);
+
+// An array is true (as an if condition) if every element is true or non-zero
+int arrayAll(Array *array);
+
+#endif
@@ -0,0 +1,226 @@
+#include "batch.h"
+#include "terp.h"
+#include "script.h"
+#include "stats.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+typedef struct tagJob {
+	char *path;
+
+	// everything the script wrote
+	char *output;
+	size_t length;
+
+	int failed;
+} Job;
+
+struct tagBatch;
+
+// Each worker owns a run of jobs, [head, tail). It takes jobs from the head; a worker with
+// nothing left steals the back half of someone else's run.
+typedef struct tagWorker {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	int head;
+	int tail;
+
+	struct tagBatch *batch;
+	int index;
+} Worker;
+
+typedef struct tagBatch {
+	Job *jobs;
+	int jobCount;
+	int jobCapacity;
+
+	Worker *workers;
+	int workerCount;
+
+	// every script's State starts with its settings
+	State *like;
+} Batch;
+
+static void addJob(Batch *batch, const char *path) {
+	if (batch->jobCount == batch->jobCapacity) {
+		batch->jobCapacity = batch->jobCapacity ? batch->jobCapacity * 2 : 64;
+		batch->jobs = (Job *)realloc(batch->jobs, batch->jobCapacity * sizeof(Job));
+	}
+
+	batch->jobs[batch->jobCount].path = strdup(path);
+	batch->jobs[batch->jobCount].output = NULL;
+	batch->jobs[batch->jobCount].length = 0;
+	batch->jobs[batch->jobCount].failed = 0;
+	batch->jobCount++;
+}
+
+static int byPath(const void *a, const void *b) {
+	return strcmp(((const Job *)a)->path, ((const Job *)b)->path);
+}
+
+// every regular file in a directory (not recursively), in name order, except the .terpc files
+// left by earlier runs
+static void addDirectory(Batch *batch, const char *path) {
+	DIR *dir = opendir(path);
+	struct dirent *entry;
+	struct stat info;
+	char *file;
+	int first = batch->jobCount;
+
+	if (dir == NULL) {
+		addJob(batch, path);
+		return;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.' || strstr(entry->d_name, ".terpc") != NULL)
+			continue;
+
+		file = malloc(strlen(path) + strlen(entry->d_name) + 2);
+		sprintf(file, "%s/%s", path, entry->d_name);
+
+		if (stat(file, &info) == 0 && S_ISREG(info.st_mode))
+			addJob(batch, file);
+
+		free(file);
+	}
+
+	closedir(dir);
+
+	qsort(batch->jobs + first, batch->jobCount - first, sizeof(Job), byPath);
+}
+
+static void runJob(Batch *batch, Job *job) {
+	State *state = initStateLike(batch->like);
+	FILE *out = open_memstream(&job->output, &job->length);
+
+	state->out = out;
+	job->failed = !interpretScript(job->path, state) || state->errors > 0;
+
+	fclose(out);
+	freeState(state);
+}
+
+// the next job for worker, its own or stolen, -1 once there are none anywhere
+static int nextJob(Worker *worker) {
+	Batch *batch = worker->batch;
+	Worker *victim;
+	int i, job = -1, middle, tail = 0;
+
+	pthread_mutex_lock(&worker->lock);
+	if (worker->head < worker->tail)
+		job = worker->head++;
+	pthread_mutex_unlock(&worker->lock);
+
+	if (job >= 0)
+		return job;
+
+	// jobs never get added, so one pass over everyone finding nothing means we're done
+	for (i = 1; i < batch->workerCount && job < 0; i++) {
+		victim = &batch->workers[(worker->index + i) % batch->workerCount];
+
+		// take the back half, or the only job left
+		pthread_mutex_lock(&victim->lock);
+
+		if (victim->head < victim->tail) {
+			middle = victim->head + (victim->tail - victim->head) / 2;
+			job = middle;
+			tail = victim->tail;
+			victim->tail = middle;
+		}
+
+		pthread_mutex_unlock(&victim->lock);
+	}
+
+	// only one lock is ever held at a time; the stolen jobs are nobody's until they're ours
+	if (job >= 0) {
+		pthread_mutex_lock(&worker->lock);
+		worker->head = job + 1;
+		worker->tail = tail;
+		pthread_mutex_unlock(&worker->lock);
+	}
+
+	return job;
+}
+
+static void *work(void *argument) {
+	Worker *worker = argument;
+	Batch *batch = worker->batch;
+	int job;
+
+	while ((job = nextJob(worker)) >= 0)
+		runJob(batch, &batch->jobs[job]);
+
+	// the first worker is the thread that started the batch, which keeps its own stats
+	if (worker->index > 0)
+		mergeStats();
+
+	return NULL;
+}
+
+int runBatch(char **paths, int count, int workers, State *like, FILE *out) {
+	Batch batch = { 0 };
+	struct stat info;
+	int i, failed = 0;
+
+	for (i = 0; i < count; i++) {
+		if (stat(paths[i], &info) == 0 && S_ISDIR(info.st_mode))
+			addDirectory(&batch, paths[i]);
+		else
+			addJob(&batch, paths[i]);
+	}
+
+	if (workers <= 0)
+		workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers > batch.jobCount)
+		workers = batch.jobCount;
+	if (workers < 1)
+		workers = 1;
+
+	batch.workers = (Worker *)calloc(workers, sizeof(Worker));
+	batch.workerCount = workers;
+	batch.like = like;
+
+	// everyone starts with an even share, in order
+	for (i = 0; i < workers; i++) {
+		pthread_mutex_init(&batch.workers[i].lock, NULL);
+		batch.workers[i].head = (int)((long)batch.jobCount * i / workers);
+		batch.workers[i].tail = (int)((long)batch.jobCount * (i + 1) / workers);
+		batch.workers[i].batch = &batch;
+		batch.workers[i].index = i;
+	}
+
+	// this thread is worker 0
+	for (i = 1; i < workers; i++)
+		pthread_create(&batch.workers[i].thread, NULL, work, &batch.workers[i]);
+
+	work(&batch.workers[0]);
+
+	for (i = 1; i < workers; i++)
+		pthread_join(batch.workers[i].thread, NULL);
+
+	for (i = 0; i < batch.jobCount; i++) {
+		if (batch.jobs[i].length > 0) {
+			fprintf(out, "==> %s <==\n", batch.jobs[i].path);
+			fwrite(batch.jobs[i].output, 1, batch.jobs[i].length, out);
+		}
+
+		failed += batch.jobs[i].failed;
+
+		free(batch.jobs[i].output);
+		free(batch.jobs[i].path);
+	}
+
+	for (i = 0; i < workers; i++)
+		pthread_mutex_destroy(&batch.workers[i].lock);
+
+	free(batch.workers);
+	free(batch.jobs);
+
+	return failed;
+}
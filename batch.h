@@ -0,0 +1,14 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "terp.h"
+
+#include <stdio.h>
+
+// Run many scripts at once, each in its own State, on a pool of threads (workers <= 0 means
+// one per core). A directory in paths stands for the files in it. Every script gets the
+// settings (tree-walking, JIT, cache size, image) of like, and what it writes is buffered
+// and copied to out in the order the scripts were given. Returns the number that failed.
+int runBatch(char **paths, int count, int workers, State *like, FILE *out);
+
+#endif
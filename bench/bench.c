@@ -0,0 +1,834 @@
+// terp benchmarks: `make bench` builds this against the interpreter's sources and runs it.
+// Each benchmark is run for a fixed amount of wall time and reported as one row of
+// JSON (default) or CSV, so results from two builds can be diffed.
+
+#include "stmt.h"
+#include "eval.h"
+#include "terp.h"
+#include "script.h"
+#include "cache.h"
+#include "symtab.h"
+#include "vm.h"
+#include "jit.h"
+#include "array.h"
+#include "value.h"
+#include "scan.h"
+#include "fold.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct tagBench {
+	const char *name;
+	void (*setup)(void);
+	void (*run)(long iterations);
+	void (*teardown)(void);
+} Bench;
+
+typedef struct tagResult {
+	long iterations;
+	double nsPerOp;
+	double allocsPerOp;
+	double bytesPerOp;
+} Result;
+
+// minimum wall time spent measuring each benchmark
+static double targetSeconds = 0.5;
+
+// results are folded into this so the compiler can't drop the work
+static volatile long sink;
+
+/*
+ * Allocation counting. glibc lets a program replace malloc and friends, so these count
+ * every allocation the interpreter makes (including ones made inside libc, like strdup)
+ * and hand the real work to glibc's own entry points.
+ */
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *pointer);
+
+static unsigned long allocations;
+static unsigned long allocatedBytes;
+
+void *malloc(size_t size) {
+	allocations++;
+	allocatedBytes += size;
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+	allocations++;
+	allocatedBytes += count * size;
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+	allocations++;
+	allocatedBytes += size;
+	return __libc_realloc(pointer, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+	allocations++;
+	allocatedBytes += size;
+	return __libc_memalign(alignment, size);
+}
+
+void free(void *pointer) {
+	__libc_free(pointer);
+}
+
+#define COUNTING_ALLOCATIONS 1
+#else
+static unsigned long allocations;
+static unsigned long allocatedBytes;
+
+#define COUNTING_ALLOCATIONS 0
+#endif
+
+static double now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Grow the iteration count until one run takes at least targetSeconds
+static Result measure(Bench *bench) {
+	Result result;
+	unsigned long allocs, bytes;
+	double start, elapsed;
+	long n = 1;
+
+	for (;;) {
+		if (bench->setup != NULL)
+			bench->setup();
+
+		allocs = allocations;
+		bytes = allocatedBytes;
+		start = now();
+
+		bench->run(n);
+
+		elapsed = now() - start;
+		allocs = allocations - allocs;
+		bytes = allocatedBytes - bytes;
+
+		if (bench->teardown != NULL)
+			bench->teardown();
+
+		if (elapsed >= targetSeconds || n >= 1L << 40)
+			break;
+
+		// aim a little past the target so the last run usually counts
+		if (elapsed <= 0)
+			n *= 100;
+		else if (elapsed * 100 < targetSeconds)
+			n *= 100;
+		else
+			n = (long)(n * targetSeconds * 1.2 / elapsed) + 1;
+	}
+
+	result.iterations = n;
+	result.nsPerOp = elapsed * 1e9 / n;
+	result.allocsPerOp = COUNTING_ALLOCATIONS ? (double)allocs / n : -1;
+	result.bytesPerOp = COUNTING_ALLOCATIONS ? (double)bytes / n : -1;
+
+	return result;
+}
+
+/*
+ * Source text generators
+ */
+
+typedef struct tagBuffer {
+	char *text;
+	size_t length;
+	size_t capacity;
+} Buffer;
+
+static void append(Buffer *buffer, const char *format, ...) {
+	va_list args;
+	int length;
+
+	for (;;) {
+		va_start(args, format);
+		length = vsnprintf(buffer->text + buffer->length, buffer->capacity - buffer->length, format, args);
+		va_end(args);
+
+		if (buffer->length + length < buffer->capacity)
+			break;
+
+		buffer->capacity = (buffer->capacity + length + 1) * 2;
+		buffer->text = realloc(buffer->text, buffer->capacity);
+	}
+
+	buffer->length += length;
+}
+
+// a + b + a + b ... with terms operands (variables, so folding leaves it alone)
+static char *arithChain(int terms) {
+	Buffer buffer = { NULL, 0, 0 };
+	int i;
+
+	append(&buffer, "a");
+	for (i = 1; i < terms; i++)
+		append(&buffer, " %c %c", "+-*+"[i % 4], i % 2 ? 'b' : 'a');
+
+	return buffer.text;
+}
+
+// if a > depth then 0 else if a > depth - 1 then 1 else ... end end
+static char *ifNest(int depth) {
+	Buffer buffer = { NULL, 0, 0 };
+	int i;
+
+	for (i = 0; i < depth; i++)
+		append(&buffer, "if a > %d then %d else ", depth - i, i);
+	append(&buffer, "0");
+	for (i = 0; i < depth; i++)
+		append(&buffer, " end");
+
+	return buffer.text;
+}
+
+// v0 + v1 + ... + vN
+static char *variableSum(int variables) {
+	Buffer buffer = { NULL, 0, 0 };
+	int i;
+
+	append(&buffer, "v0");
+	for (i = 1; i < variables; i++)
+		append(&buffer, " + v%d", i);
+
+	return buffer.text;
+}
+
+// a mix of assignments, arithmetic and conditionals, one statement per line
+static char *scriptText(int statements) {
+	Buffer buffer = { NULL, 0, 0 };
+	int i;
+
+	for (i = 0; i < statements; i++) {
+		switch(i % 4) {
+		case 0:
+			append(&buffer, "x%d = %d\n", i % 64, i);
+			break;
+		case 1:
+			append(&buffer, "y = x%d * 3 + x%d - 7\n", (i - 1) % 64, (i + 5) % 64);
+			break;
+		case 2:
+			append(&buffer, "if y > %d then z = y / 2 else z = y end\n", i);
+			break;
+		default:
+			append(&buffer, "x%d = x%d + z\n", (i * 7) % 64, i % 64);
+			break;
+		}
+	}
+
+	return buffer.text;
+}
+
+/*
+ * Parsing
+ */
+
+static Statement *parsed;
+static const char *source;
+static char *generated;
+
+static void parseSetup(void) {
+	parsed = newStatement();
+}
+
+static void parseTeardown(void) {
+	deleteStatement(parsed);
+}
+
+// bison's front end, whichever one the build uses, so the parse/scan ones have it to beat
+static void parseRun(long n) {
+	long i;
+
+	for (i = 0; i < n; i++)
+		sink += bisonST(source, parsed);
+}
+
+static void parseShortSetup(void) {
+	source = "x = y + 12 * z";
+	parseSetup();
+}
+
+static void parseLongSetup(void) {
+	free(generated);
+	source = generated = arithChain(500);
+	parseSetup();
+}
+
+// the hand-written front end, doing what buildST() does with it
+static void scanRun(long n) {
+	long i;
+
+	for (i = 0; i < n; i++) {
+		resetStatement(parsed);
+
+		if (scanStatement(parsed, source, strlen(source))) {
+			foldStatement(parsed);
+			sink++;
+		}
+	}
+}
+
+// whether two parses made the same nodes, names and roots (arrays and big integers are
+// compared by where they are, not what's in them)
+static int sameParse(Statement *a, Statement *b) {
+	ParseNode x, y;
+	int i;
+
+	if (a->count != b->count || a->rootCount != b->rootCount || a->namesLength != b->namesLength)
+		return 0;
+
+	if (memcmp(a->roots, b->roots, a->rootCount * sizeof(NodeId)) != 0 || memcmp(a->names, b->names, a->namesLength) != 0)
+		return 0;
+
+	for (i = 0; i < a->count; i++) {
+		x = a->nodes[i];
+		y = b->nodes[i];
+
+		if (x.sType == sARRAY || x.sType == sBIG)
+			x.value = y.value;
+
+		if (memcmp(&x, &y, sizeof x) != 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+// the text is parsed by bison too, so a difference between the front ends stops the bench
+static void scanSetup(void) {
+	Statement *expected = newStatement();
+
+	parseSetup();
+	bisonST(source, expected);
+	scanRun(1);
+
+	if (!sameParse(parsed, expected)) {
+		fprintf(stderr, "the front ends disagree on: %.60s\n", source);
+		exit(1);
+	}
+
+	deleteStatement(expected);
+}
+
+static void scanShortSetup(void) {
+	source = "x = y + 12 * z";
+	scanSetup();
+}
+
+static void scanLongSetup(void) {
+	free(generated);
+	source = generated = arithChain(500);
+	scanSetup();
+}
+
+static void scanScriptSetup(void) {
+	free(generated);
+	source = generated = scriptText(1000);
+	scanSetup();
+}
+
+static void parseScriptSetup(void) {
+	free(generated);
+	source = generated = scriptText(1000);
+	parseSetup();
+}
+
+/*
+ * Evaluation: the statement is parsed and resolved once, then evaluated over and over
+ */
+
+static State *state;
+static NodeId root;
+static Chunk *chunk;
+static JitCode *native;
+
+static void evalSetup(const char *text) {
+	int i;
+
+	state = initState();
+	parsed = newStatement();
+
+	// benchmarks don't want to see errors, the State still counts them
+	state->out = NULL;
+
+	buildST(text, parsed);
+	resolveStatement(parsed, state);
+	root = parsed->roots[0];
+
+	// every variable in these statements holds a small number
+	for (i = 0; i < state->slotCount; i++) {
+		state->slots[i].value.type = tINT;
+		state->slots[i].value.value.integer = i + 1;
+		state->slots[i].defined = 1;
+	}
+
+	chunk = compile(parsed, root, state);
+	native = jitCompile(parsed, root);
+}
+
+static void evalTeardown(void) {
+	jitFree(native);
+	freeChunk(chunk);
+	deleteStatement(parsed);
+	freeState(state);
+}
+
+static void treeRun(long n) {
+	long i;
+
+	for (i = 0; i < n; i++)
+		sink += evaluate(parsed, root, state).value.integer;
+}
+
+static void vmRun(long n) {
+	long i;
+
+	for (i = 0; i < n; i++)
+		sink += execute(chunk, state).value.integer;
+}
+
+// falls back to the VM where there is no native code, like evaluateEntry() does
+static void nativeRun(long n) {
+	Element result;
+	long i;
+
+	for (i = 0; i < n; i++) {
+		if (native == NULL || !jitRun(native, state, &result))
+			result = execute(chunk, state);
+
+		sink += result.value.integer;
+	}
+}
+
+static void arithSetup(void) {
+	free(generated);
+	evalSetup(generated = arithChain(100));
+}
+
+static void ifSetup(void) {
+	free(generated);
+	evalSetup(generated = ifNest(50));
+}
+
+static void variableSetup(void) {
+	free(generated);
+	evalSetup(generated = variableSum(100));
+}
+
+/*
+ * Elementwise arithmetic and comparison on 10k element arrays
+ */
+
+#define ARRAY_LENGTH 10000
+
+static void arraySetup(const char *text, ElemType type) {
+	Array *array;
+	int i, j;
+
+	evalSetup(text);
+
+	for (i = 0; i < state->slotCount; i++) {
+		array = newArray(type, ARRAY_LENGTH);
+
+		for (j = 0; j < ARRAY_LENGTH; j++) {
+			if (type == eREAL)
+				((double *)array->data)[j] = (i + 1) * 0.5 + j;
+			else
+				((int32_t *)array->data)[j] = (i + 1) * j;
+		}
+
+		state->slots[i].value = keepValue(state, (Element){ tSET, { .array = array } });
+	}
+}
+
+static void arrayRun(long n) {
+	long i;
+
+	// results are dropped between statements, like they would be in a script
+	for (i = 0; i < n; i++) {
+		collectGarbage(state);
+		sink += execute(chunk, state).type;
+	}
+}
+
+static void arrayIntSetup(void) {
+	arraySetup("a * b + a - 3", eINT32);
+}
+
+static void arrayRealSetup(void) {
+	arraySetup("a * b + a - 3.5", eREAL);
+}
+
+static void arrayCompareSetup(void) {
+	arraySetup("a * 2 < b", eREAL);
+}
+
+// products that don't fit in 32 bits, so the array is widened. The results have to be exactly
+// what scalar arithmetic gives, and a 64 bit array that overflows has to become reals, or
+// the bench stops.
+static void arrayWidenSetup(void) {
+	Array *wide = newArray(eINT64, 1);
+	Element result;
+	int j;
+
+	arraySetup("a * 1000000 + b", eINT32);
+	result = execute(chunk, state);
+
+	for (j = 0; j < ARRAY_LENGTH; j++) {
+		if (result.type != tSET || result.value.array->type != eINT64
+			|| ((int64_t *)result.value.array->data)[j] != (int64_t)j * 1000000 + 2 * j) {
+			fprintf(stderr, "array arithmetic disagrees with scalar arithmetic at element %d\n", j);
+			exit(1);
+		}
+	}
+
+	((int64_t *)wide->data)[0] = INT64_MAX;
+	result = arrayArithmetic(NULL, aPLUS, (Element){ tSET, { .array = wide } }, (Element){ tINT, { .integer = 1 } });
+
+	if (result.type != tSET || result.value.array->type != eREAL || ((double *)result.value.array->data)[0] != 9223372036854775808.0) {
+		fprintf(stderr, "a 64 bit array that overflows doesn't become reals\n");
+		exit(1);
+	}
+
+	freeValue(result);
+	freeArray(wide);
+}
+
+/*
+ * Variable lookups in a State holding 10, 1k and 100k names
+ */
+
+static char **names;
+static int nameCount;
+
+static void lookupSetup(int count) {
+	char name[32];
+	int i;
+
+	state = initState();
+	state->out = NULL;
+	names = malloc(count * sizeof(char *));
+	nameCount = count;
+
+	for (i = 0; i < count; i++) {
+		snprintf(name, sizeof name, "var%d", i);
+		names[i] = strdup(name);
+		lookupSlot(state, names[i]);
+	}
+}
+
+static void lookupTeardown(void) {
+	int i;
+
+	for (i = 0; i < nameCount; i++)
+		free(names[i]);
+	free(names);
+	freeState(state);
+}
+
+static void lookupRun(long n) {
+	long i;
+	int j = 0;
+
+	// walk the names in a stride so consecutive lookups land in different groups
+	for (i = 0; i < n; i++) {
+		sink += lookupSlot(state, names[j]);
+		j += 7919;
+		if (j >= nameCount)
+			j %= nameCount;
+	}
+}
+
+static void lookup10Setup(void) {
+	lookupSetup(10);
+}
+
+static void lookup1kSetup(void) {
+	lookupSetup(1000);
+}
+
+static void lookup100kSetup(void) {
+	lookupSetup(100000);
+}
+
+/*
+ * Reactive mode: a sheet of definitions, one input changed and one result read back
+ */
+
+static void reactiveSetup(int cells) {
+	Element result;
+	char line[64];
+	int i;
+
+	state = initState();
+	state->out = NULL;
+	state->reactive = 1;
+
+	// each output is defined in terms of its own input
+	for (i = 0; i < cells; i++) {
+		snprintf(line, sizeof line, "in%d = %d", i, i);
+		evaluateLine(line, state, &result);
+		snprintf(line, sizeof line, "out%d = in%d * 3 + 1", i, i);
+		evaluateLine(line, state, &result);
+	}
+}
+
+static void reactiveTeardown(void) {
+	freeState(state);
+}
+
+static void reactiveRun(long n) {
+	Element result;
+	long i;
+
+	// only out17 is recomputed, however big the sheet is
+	for (i = 0; i < n; i++) {
+		evaluateLine(i & 1 ? "in17 = 5" : "in17 = 6", state, &result);
+		evaluateLine("out17", state, &result);
+		sink += result.value.integer;
+	}
+}
+
+static void reactive1kSetup(void) {
+	reactiveSetup(1000);
+}
+
+static void reactive100kSetup(void) {
+	reactiveSetup(100000);
+}
+
+/*
+ * A recursive function, memoized and not
+ */
+
+static char *definition;
+
+static void callSetup(char *text) {
+	Element result;
+
+	state = initState();
+	state->out = NULL;
+
+	definition = text;
+	evaluateLine("k = 0", state, &result);
+}
+
+static void callTeardown(void) {
+	freeState(state);
+}
+
+static void callRun(long n) {
+	Element result;
+	long i;
+
+	// defining the function again empties its memo, so every run does the whole recursion
+	for (i = 0; i < n; i++) {
+		evaluateLine(definition, state, &result);
+		evaluateLine("fib(25)", state, &result);
+		sink += result.value.integer;
+	}
+}
+
+static void fibMemoSetup(void) {
+	callSetup("def fib(n) = if n < 2 then n else fib(n - 1) + fib(n - 2) end");
+}
+
+// reading the global k makes it impure, so all 240k calls are made
+static void fibNoMemoSetup(void) {
+	callSetup("def fib(n) = if n < 2 then n + k else fib(n - 1) + fib(n - 2) end");
+}
+
+/*
+ * A loop over 10k integers, whose total comes back to where it started each run
+ */
+
+// a reduction, with (15003 * k) worked out once
+static void loopReductionSetup(void) {
+	evalSetup("for i in 1..10001 do s = s + (i * k - (15003 * k)) end");
+}
+
+// the same sum, but reading s in the expression means the body runs every time
+static void loopBodySetup(void) {
+	evalSetup("for i in 1..10001 do s = s + ((s * 0) + (i * k) - (15003 * k)) end");
+}
+
+/*
+ * Whole scripts, written to a temporary file and run with interpretScript()
+ */
+
+static char scriptPath[] = "/tmp/terp-bench-XXXXXX";
+static int scriptStatements;
+
+// whether runs go through a .terpc file (the first one writes it)
+static int scriptPrecompiled;
+
+static void scriptSetup(void) {
+	char *text;
+	int fd;
+
+	strcpy(scriptPath + strlen(scriptPath) - 6, "XXXXXX");
+	fd = mkstemp(scriptPath);
+
+	text = scriptText(scriptStatements);
+	if (fd < 0 || write(fd, text, strlen(text)) != (ssize_t)strlen(text)) {
+		fprintf(stderr, "bench: could not write %s\n", scriptPath);
+		exit(1);
+	}
+
+	close(fd);
+	free(text);
+}
+
+static void scriptTeardown(void) {
+	char terpc[sizeof scriptPath + 6];
+
+	sprintf(terpc, "%s.terpc", scriptPath);
+	unlink(terpc);
+	unlink(scriptPath);
+}
+
+static void scriptRun(long n) {
+	long i;
+
+	// a fresh State each time, without a cache, so every run parses (or loads) the whole script
+	for (i = 0; i < n; i++) {
+		state = initState();
+		state->out = NULL;
+		state->precompiled = scriptPrecompiled;
+		freeCache(state->cache);
+		state->cache = NULL;
+
+		interpretScript(scriptPath, state);
+		sink += state->slotCount;
+
+		freeState(state);
+	}
+}
+
+static void script1kSetup(void) {
+	scriptStatements = 1000;
+	scriptPrecompiled = 0;
+	scriptSetup();
+}
+
+static void script100kSetup(void) {
+	scriptStatements = 100000;
+	scriptPrecompiled = 0;
+	scriptSetup();
+}
+
+static void script100kTerpcSetup(void) {
+	scriptStatements = 100000;
+	scriptPrecompiled = 1;
+	scriptSetup();
+}
+
+static Bench benches[] = {
+	{ "parse/short",		parseShortSetup,	parseRun,	parseTeardown },
+	{ "parse/long",			parseLongSetup,		parseRun,	parseTeardown },
+	{ "parse/script-1k",		parseScriptSetup,	parseRun,	parseTeardown },
+	{ "parse/scan/short",		scanShortSetup,		scanRun,	parseTeardown },
+	{ "parse/scan/long",		scanLongSetup,		scanRun,	parseTeardown },
+	{ "parse/scan/script-1k",	scanScriptSetup,	scanRun,	parseTeardown },
+	{ "eval/tree/arith-chain",	arithSetup,		treeRun,	evalTeardown },
+	{ "eval/vm/arith-chain",	arithSetup,		vmRun,		evalTeardown },
+	{ "eval/jit/arith-chain",	arithSetup,		nativeRun,	evalTeardown },
+	{ "eval/tree/if-nest",		ifSetup,		treeRun,	evalTeardown },
+	{ "eval/vm/if-nest",		ifSetup,		vmRun,		evalTeardown },
+	{ "eval/jit/if-nest",		ifSetup,		nativeRun,	evalTeardown },
+	{ "eval/tree/variables",	variableSetup,		treeRun,	evalTeardown },
+	{ "eval/vm/variables",		variableSetup,		vmRun,		evalTeardown },
+	{ "eval/jit/variables",		variableSetup,		nativeRun,	evalTeardown },
+	{ "array/int-10k",		arrayIntSetup,		arrayRun,	evalTeardown },
+	{ "array/real-10k",		arrayRealSetup,		arrayRun,	evalTeardown },
+	{ "array/compare-10k",		arrayCompareSetup,	arrayRun,	evalTeardown },
+	{ "array/int-widen-10k",	arrayWidenSetup,	arrayRun,	evalTeardown },
+	{ "lookup/10",			lookup10Setup,		lookupRun,	lookupTeardown },
+	{ "lookup/1k",			lookup1kSetup,		lookupRun,	lookupTeardown },
+	{ "lookup/100k",		lookup100kSetup,	lookupRun,	lookupTeardown },
+	{ "reactive/1k",		reactive1kSetup,	reactiveRun,	reactiveTeardown },
+	{ "reactive/100k",		reactive100kSetup,	reactiveRun,	reactiveTeardown },
+	{ "call/fib-25/memo",		fibMemoSetup,		callRun,	callTeardown },
+	{ "call/fib-25/no-memo",	fibNoMemoSetup,		callRun,	callTeardown },
+	{ "loop/tree/reduction",	loopReductionSetup,	treeRun,	evalTeardown },
+	{ "loop/vm/reduction",		loopReductionSetup,	vmRun,		evalTeardown },
+	{ "loop/tree/body",		loopBodySetup,		treeRun,	evalTeardown },
+	{ "loop/vm/body",		loopBodySetup,		vmRun,		evalTeardown },
+	{ "script/1k",			script1kSetup,		scriptRun,	scriptTeardown },
+	{ "script/100k",		script100kSetup,	scriptRun,	scriptTeardown },
+	{ "script/100k-terpc",		script100kTerpcSetup,	scriptRun,	scriptTeardown },
+	{ NULL }
+};
+
+static void usage(void) {
+	fprintf(stderr, "usage: terp-bench [--csv | --json] [--time seconds] [--filter substring]\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[]) {
+	const char *filter = NULL;
+	Result result;
+	int csv = 0, first = 1;
+	Bench *bench;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--csv") == 0)
+			csv = 1;
+		else if (strcmp(argv[i], "--json") == 0)
+			csv = 0;
+		else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc)
+			targetSeconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+			filter = argv[++i];
+		else
+			usage();
+	}
+
+	if (csv)
+		printf("name,iterations,ns_per_op,ops_per_sec,allocs_per_op,bytes_per_op\n");
+	else
+		printf("[\n");
+
+	for (bench = benches; bench->name != NULL; bench++) {
+		if (filter != NULL && strstr(bench->name, filter) == NULL)
+			continue;
+
+		result = measure(bench);
+
+		if (csv) {
+			printf("%s,%ld,%.2f,%.0f,%.2f,%.1f\n", bench->name, result.iterations, result.nsPerOp,
+				1e9 / result.nsPerOp, result.allocsPerOp, result.bytesPerOp);
+		} else {
+			printf("%s  {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f, "
+				"\"allocs_per_op\": %.2f, \"bytes_per_op\": %.1f}", first ? "" : ",\n", bench->name,
+				result.iterations, result.nsPerOp, 1e9 / result.nsPerOp, result.allocsPerOp, result.bytesPerOp);
+		}
+
+		first = 0;
+		fflush(stdout);
+	}
+
+	if (!csv)
+		printf("%s]\n", first ? "" : "\n");
+
+	free(generated);
+	return 0;
+}
@@ -0,0 +1,385 @@
+#include "bigint.h"
+#include "stmt.h"
+#include "terp.h"
+#include "value.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static BigInt *allocateBig(int capacity) {
+	BigInt *big = (BigInt *)malloc(sizeof(BigInt));
+
+	big->limbs = (uint32_t *)calloc(capacity + 1, sizeof(uint32_t));
+	big->length = 0;
+	big->negative = 0;
+	big->marked = 0;
+
+	return big;
+}
+
+// drop high zero limbs (and the sign of zero)
+static void trim(BigInt *big) {
+	while (big->length > 0 && big->limbs[big->length - 1] == 0)
+		big->length--;
+
+	if (big->length == 0)
+		big->negative = 0;
+}
+
+BigInt *bigFromString(const char *digits) {
+	BigInt *big = allocateBig(strlen(digits) / 9 + 2);
+	uint64_t carry;
+	int i;
+
+	// every digit: big = big * 10 + digit
+	for (; *digits >= '0' && *digits <= '9'; digits++) {
+		carry = *digits - '0';
+
+		for (i = 0; i < big->length; i++) {
+			carry += (uint64_t)big->limbs[i] * 10;
+			big->limbs[i] = (uint32_t)carry;
+			carry >>= 32;
+		}
+
+		if (carry != 0)
+			big->limbs[big->length++] = (uint32_t)carry;
+	}
+
+	return big;
+}
+
+BigInt *bigFromInteger(int64_t value) {
+	BigInt *big = allocateBig(2);
+	uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+	big->limbs[0] = (uint32_t)magnitude;
+	big->limbs[1] = (uint32_t)(magnitude >> 32);
+	big->length = 2;
+	big->negative = value < 0;
+	trim(big);
+
+	return big;
+}
+
+BigInt *bigFromLimbs(const uint32_t *limbs, int length, int negative) {
+	BigInt *big = allocateBig(length);
+
+	memcpy(big->limbs, limbs, length * sizeof(uint32_t));
+	big->length = length;
+	big->negative = negative;
+	trim(big);
+
+	return big;
+}
+
+BigInt *copyBig(BigInt *big) {
+	BigInt *copy = allocateBig(big->length);
+
+	memcpy(copy->limbs, big->limbs, big->length * sizeof(uint32_t));
+	copy->length = big->length;
+	copy->negative = big->negative;
+
+	return copy;
+}
+
+void freeBig(BigInt *big) {
+	if (big == NULL)
+		return;
+
+	free(big->limbs);
+	free(big);
+}
+
+double bigToDouble(BigInt *big) {
+	double value = 0;
+	int i;
+
+	for (i = big->length - 1; i >= 0; i--)
+		value = value * 4294967296.0 + big->limbs[i];
+
+	return big->negative ? -value : value;
+}
+
+// divide the magnitude in place by a small divisor, returning the remainder
+static uint32_t divideSmall(uint32_t *limbs, int length, uint32_t divisor) {
+	uint64_t remainder = 0;
+	int i;
+
+	for (i = length - 1; i >= 0; i--) {
+		remainder = remainder << 32 | limbs[i];
+		limbs[i] = (uint32_t)(remainder / divisor);
+		remainder %= divisor;
+	}
+
+	return (uint32_t)remainder;
+}
+
+char *bigToString(BigInt *big) {
+	uint32_t *limbs = (uint32_t *)malloc((big->length + 1) * sizeof(uint32_t));
+	char *text = (char *)malloc(big->length * 10 + 3);
+	char *end = text + big->length * 10 + 2, *start;
+	uint32_t chunk;
+	int length = big->length, i;
+
+	memcpy(limbs, big->limbs, length * sizeof(uint32_t));
+	*end = '\0';
+	start = end;
+
+	// nine digits at a time, least significant first
+	do {
+		chunk = divideSmall(limbs, length, 1000000000);
+
+		while (length > 0 && limbs[length - 1] == 0)
+			length--;
+
+		for (i = 0; i < 9 && (length > 0 || chunk != 0 || i == 0); i++) {
+			*--start = '0' + chunk % 10;
+			chunk /= 10;
+		}
+	} while (length > 0);
+
+	if (big->negative)
+		*--start = '-';
+
+	memmove(text, start, end - start + 1);
+	free(limbs);
+
+	return text;
+}
+
+/*
+ * Magnitudes
+ */
+
+static int compareMagnitude(const BigInt *a, const BigInt *b) {
+	int i;
+
+	if (a->length != b->length)
+		return a->length < b->length ? -1 : 1;
+
+	for (i = a->length - 1; i >= 0; i--) {
+		if (a->limbs[i] != b->limbs[i])
+			return a->limbs[i] < b->limbs[i] ? -1 : 1;
+	}
+
+	return 0;
+}
+
+static BigInt *addMagnitude(const BigInt *a, const BigInt *b) {
+	int length = (a->length > b->length ? a->length : b->length) + 1, i;
+	BigInt *sum = allocateBig(length);
+	uint64_t carry = 0;
+
+	for (i = 0; i < length; i++) {
+		carry += (uint64_t)(i < a->length ? a->limbs[i] : 0) + (i < b->length ? b->limbs[i] : 0);
+		sum->limbs[i] = (uint32_t)carry;
+		carry >>= 32;
+	}
+
+	sum->length = length;
+	trim(sum);
+
+	return sum;
+}
+
+// subtract b from a in place, |a| >= |b|
+static void subtractMagnitude(BigInt *a, const BigInt *b) {
+	int64_t difference, borrow = 0;
+	int i;
+
+	for (i = 0; i < a->length; i++) {
+		difference = (int64_t)a->limbs[i] - (i < b->length ? b->limbs[i] : 0) - borrow;
+		borrow = difference < 0;
+		a->limbs[i] = (uint32_t)difference;
+	}
+
+	trim(a);
+}
+
+static BigInt *multiplyMagnitude(const BigInt *a, const BigInt *b) {
+	BigInt *product = allocateBig(a->length + b->length);
+	uint64_t carry;
+	int i, j;
+
+	for (i = 0; i < a->length; i++) {
+		carry = 0;
+
+		for (j = 0; j < b->length; j++) {
+			carry += (uint64_t)a->limbs[i] * b->limbs[j] + product->limbs[i + j];
+			product->limbs[i + j] = (uint32_t)carry;
+			carry >>= 32;
+		}
+
+		product->limbs[i + b->length] = (uint32_t)carry;
+	}
+
+	product->length = a->length + b->length;
+	trim(product);
+
+	return product;
+}
+
+// |a| / |b|, truncated; b isn't zero
+static BigInt *divideMagnitude(const BigInt *a, const BigInt *b) {
+	BigInt *quotient = allocateBig(a->length), *remainder;
+	int bit, i;
+
+	memcpy(quotient->limbs, a->limbs, a->length * sizeof(uint32_t));
+	quotient->length = a->length;
+
+	if (b->length == 1) {
+		divideSmall(quotient->limbs, quotient->length, b->limbs[0]);
+		trim(quotient);
+		return quotient;
+	}
+
+	// shift and subtract, a bit at a time
+	memset(quotient->limbs, 0, a->length * sizeof(uint32_t));
+	remainder = allocateBig(b->length + 1);
+
+	for (bit = a->length * 32 - 1; bit >= 0; bit--) {
+		// remainder = remainder * 2 + next bit of a
+		for (i = remainder->length; i > 0; i--)
+			remainder->limbs[i] = remainder->limbs[i] << 1 | remainder->limbs[i - 1] >> 31;
+		remainder->limbs[0] = remainder->limbs[0] << 1 | ((a->limbs[bit / 32] >> (bit % 32)) & 1);
+
+		if (remainder->limbs[remainder->length] != 0)
+			remainder->length++;
+
+		if (compareMagnitude(remainder, b) >= 0) {
+			subtractMagnitude(remainder, b);
+			quotient->limbs[bit / 32] |= 1u << (bit % 32);
+		}
+	}
+
+	freeBig(remainder);
+	trim(quotient);
+
+	return quotient;
+}
+
+/*
+ * Values
+ */
+
+// look at an integer (or boolean) as a BigInt without allocating, using limbs for storage
+static BigInt view(Element e, uint32_t *limbs) {
+	BigInt big;
+	int64_t value;
+	uint64_t magnitude;
+
+	if (e.type == tBIG)
+		return *e.value.big;
+
+	value = integerOf(e);
+	magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+	limbs[0] = (uint32_t)magnitude;
+	limbs[1] = (uint32_t)(magnitude >> 32);
+
+	big.limbs = limbs;
+	big.length = 2;
+	big.negative = value < 0;
+	big.marked = 0;
+	trim(&big);
+
+	return big;
+}
+
+// a + b, where b's sign has been flipped if it's a subtraction
+static BigInt *add(const BigInt *a, const BigInt *b) {
+	BigInt *result;
+
+	if (a->negative == b->negative) {
+		result = addMagnitude(a, b);
+		result->negative = a->negative;
+	} else if (compareMagnitude(a, b) >= 0) {
+		result = copyBig((BigInt *)a);
+		subtractMagnitude(result, b);
+	} else {
+		result = copyBig((BigInt *)b);
+		subtractMagnitude(result, a);
+	}
+
+	trim(result);
+	return result;
+}
+
+Element bigArithmetic(State *state, ArithOp op, Element left, Element right) {
+	uint32_t leftLimbs[2], rightLimbs[2];
+	BigInt a = view(left, leftLimbs), b = view(right, rightLimbs), *big;
+	uint64_t magnitude;
+	Element result;
+
+	switch(op) {
+	case aPLUS:
+		big = add(&a, &b);
+		break;
+	case aSUB:
+		b.negative = b.length > 0 && !b.negative;
+		big = add(&a, &b);
+		break;
+	case aMULT:
+		big = multiplyMagnitude(&a, &b);
+		big->negative = big->length > 0 && a.negative != b.negative;
+		break;
+	case aDIV:
+		if (b.length == 0) {
+			error(state, "Division by zero");
+			return NIL;
+		}
+
+		big = divideMagnitude(&a, &b);
+		big->negative = big->length > 0 && a.negative != b.negative;
+		break;
+	default:
+		error(state, "Unknown arithmetic operation");
+		return NIL;
+	}
+
+	// back to a plain integer if it fits in one
+	if (big->length <= 2) {
+		magnitude = big->length == 0 ? 0 : big->length == 1 ? big->limbs[0] : (uint64_t)big->limbs[1] << 32 | big->limbs[0];
+
+		if (magnitude <= (big->negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX)) {
+			result.type = tINT;
+			result.value.integer = big->negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+			freeBig(big);
+			return result;
+		}
+	}
+
+	result.type = tBIG;
+	result.value.big = big;
+	return keepValue(state, result);
+}
+
+Element bigCompare(State *state, BoolOp op, Element left, Element right) {
+	uint32_t leftLimbs[2], rightLimbs[2];
+	BigInt a = view(left, leftLimbs), b = view(right, rightLimbs);
+	Element result;
+	int order;
+
+	if (a.negative != b.negative)
+		order = a.negative ? -1 : 1;
+	else
+		order = a.negative ? -compareMagnitude(&a, &b) : compareMagnitude(&a, &b);
+
+	result.type = tBOOL;
+
+	switch(op) {
+	case bLESSTHAN:
+		result.value.boolean = order < 0;
+		return result;
+	case bGREATERTHAN:
+		result.value.boolean = order > 0;
+		return result;
+	case bEQUALTO:
+		result.value.boolean = order == 0;
+		return result;
+	default:
+		error(state, "Unknown boolean operation");
+		return NIL;
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef __BIGINT_H__
+#define __BIGINT_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+#include <stdint.h>
+
+// A tBIG value: an integer too big for int64_t. Integers are only ever big when they have to be,
+// results that fit in 64 bits are turned back into tINT.
+typedef struct tagBigInt {
+	// magnitude, least significant limb first, with no high zero limbs
+	uint32_t *limbs;
+	int length;
+
+	int negative;
+
+	// set while collectGarbage() is looking for values still in use
+	int marked;
+} BigInt;
+
+// Parse a string of decimal digits
+BigInt *bigFromString(const char *digits);
+BigInt *bigFromInteger(int64_t value);
+
+// A magnitude, least significant limb first
+BigInt *bigFromLimbs(const uint32_t *limbs, int length, int negative);
+
+BigInt *copyBig(BigInt *big);
+void freeBig(BigInt *big);
+
+double bigToDouble(BigInt *big);
+
+// Decimal representation, the caller frees it
+char *bigToString(BigInt *big);
+
+// Arithmetic and comparison between integers where either side (or the result of an
+// int64_t operation) is big. The result is an int if it fits.
+Element bigArithmetic(State *state, ArithOp op, Element left, Element right);
+Element bigCompare(State *state, BoolOp op, Element left, Element right);
+
+#endif
@@ -0,0 +1,130 @@
+#include "cache.h"
+#include "stmt.h"
+#include "symtab.h"
+#include "vm.h"
+
+#include <stdlib.h>
+
+StatementCache *newCache(int capacity) {
+	StatementCache *cache = (StatementCache *)malloc(sizeof(StatementCache));
+
+	cache->index = newSymbolTable();
+	cache->entries = (CacheEntry *)malloc(capacity * sizeof(CacheEntry));
+	cache->count = 0;
+	cache->capacity = capacity;
+	cache->head = -1;
+	cache->tail = -1;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->evictions = 0;
+
+	return cache;
+}
+
+static void releaseChunks(CacheEntry *entry) {
+	int i;
+
+	for (i = 0; i < entry->stmt->rootCount; i++)
+		freeChunk(entry->chunks[i]);
+
+	free(entry->chunks);
+	entry->chunks = NULL;
+}
+
+void freeCache(StatementCache *cache) {
+	int i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < cache->count; i++) {
+		releaseChunks(&cache->entries[i]);
+		deleteStatement(cache->entries[i].stmt);
+	}
+
+	freeSymbolTable(cache->index);
+	free(cache->entries);
+	free(cache);
+}
+
+static void unlink(StatementCache *cache, int i) {
+	CacheEntry *entry = &cache->entries[i];
+
+	if (entry->prev >= 0)
+		cache->entries[entry->prev].next = entry->next;
+	else
+		cache->head = entry->next;
+
+	if (entry->next >= 0)
+		cache->entries[entry->next].prev = entry->prev;
+	else
+		cache->tail = entry->prev;
+}
+
+static void pushFront(StatementCache *cache, int i) {
+	CacheEntry *entry = &cache->entries[i];
+
+	entry->prev = -1;
+	entry->next = cache->head;
+
+	if (cache->head >= 0)
+		cache->entries[cache->head].prev = i;
+	else
+		cache->tail = i;
+
+	cache->head = i;
+}
+
+CacheEntry *cacheLookup(StatementCache *cache, const char *text) {
+	int *i = symbolLookup(cache->index, text);
+
+	if (i == NULL) {
+		cache->misses++;
+		return NULL;
+	}
+
+	cache->hits++;
+
+	if (cache->head != *i) {
+		unlink(cache, *i);
+		pushFront(cache, *i);
+	}
+
+	return &cache->entries[*i];
+}
+
+CacheEntry *cacheInsert(StatementCache *cache, const char *text, Statement *stmt, Statement **recycled) {
+	CacheEntry *entry;
+	int i, created, *slot;
+
+	*recycled = NULL;
+
+	if (cache->count < cache->capacity) {
+		i = cache->count++;
+	} else {
+		// reuse the least recently used entry
+		i = cache->tail;
+		entry = &cache->entries[i];
+
+		unlink(cache, i);
+		symbolRemove(cache->index, entry->text);
+		releaseChunks(entry);
+
+		resetStatement(entry->stmt);
+		*recycled = entry->stmt;
+
+		cache->evictions++;
+	}
+
+	slot = symbolInsert(cache->index, text, &created);
+	*slot = i;
+
+	entry = &cache->entries[i];
+	entry->stmt = stmt;
+	entry->chunks = (Chunk **)calloc(stmt->rootCount, sizeof(Chunk *));
+	entry->text = SYMBOL_OF(slot)->key;
+
+	pushFront(cache, i);
+
+	return entry;
+}
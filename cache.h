@@ -0,0 +1,54 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include "stmt.h"
+#include "symtab.h"
+#include "vm.h"
+
+// number of lines remembered unless told otherwise
+#define DEFAULT_CACHE_SIZE 256
+
+typedef struct tagCacheEntry {
+	// resolved tree for the line, and its roots' bytecode (compiled on first use)
+	Statement *stmt;
+	Chunk **chunks;
+
+	// points at the key owned by the index
+	const char *text;
+
+	// least recently used list
+	int prev;
+	int next;
+} CacheEntry;
+
+// Bounded LRU map from source text to parsed (and compiled) statements.
+// Statements are resolved against one State, so each State has its own cache.
+typedef struct tagStatementCache {
+	// text -> entry index
+	SymbolTable *index;
+
+	CacheEntry *entries;
+	int count;
+	int capacity;
+
+	// most and least recently used entries
+	int head;
+	int tail;
+
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} StatementCache;
+
+StatementCache *newCache(int capacity);
+void freeCache(StatementCache *cache);
+
+// Find the entry for some text and mark it as recently used, NULL on a miss
+CacheEntry *cacheLookup(StatementCache *cache, const char *text);
+
+// Take ownership of stmt as the entry for text. If the cache was full the least recently
+// used entry is dropped, and its (reset) Statement is handed back through *recycled so the
+// caller can parse into it next time; otherwise *recycled is NULL.
+CacheEntry *cacheInsert(StatementCache *cache, const char *text, Statement *stmt, Statement **recycled);
+
+#endif
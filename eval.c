@@ -1,223 +1,647 @@
 #include "eval.h"
 #include "stmt.h"
 #include "terp.h"
-#include "khash.h"
+#include "vm.h"
+#include "cache.h"
+#include "fold.h"
+#include "value.h"
+#include "stats.h"
+#include "jit.h"
+#include "reactive.h"
+#include "scan.h"
+#include "function.h"
+#include "loop.h"
 
 #include "parse.h"
 #include "lex.h"
 
-#define NIL nil()
+#include <stdlib.h>
+#include <string.h>
 
-// nil singleton
-Element *_nil = NULL;
-Element *nil() {
-	if (_nil == NULL) {
-		_nil = malloc(sizeof(Element));
-		_nil->type = tNIL;
-	}
+// where the walk is in a node: how many of its children have been evaluated
+typedef struct tagTask {
+	NodeId id;
+	int step;
+} Task;
+
+// walks up to this deep keep their stacks in evaluate()'s frame (values only pile up on the
+// right hand side of a tree, which is never far from its root)
+#define SMALL_TASKS 256
+#define SMALL_VALUES 64
+
+// The tree-walker's stacks: nodes still being worked on, and the values of the children
+// they've evaluated. They're on the heap once they outgrow the small ones, so how deep a tree
+// goes doesn't matter.
+typedef struct tagWalk {
+	Task *tasks;
+	int taskCount;
+	int taskCapacity;
+
+	Element *values;
+	int valueCount;
+	int valueCapacity;
+
+	Task smallTasks[SMALL_TASKS];
+	Element smallValues[SMALL_VALUES];
+} Walk;
+
+// twice the room for items of size bytes, moving them off the small stack if they're on it
+static void *grow(void *items, void *small, int *capacity, size_t size) {
+	void *bigger;
+
+	*capacity *= 2;
+
+	if (items != small)
+		return realloc(items, *capacity * size);
+
+	bigger = malloc(*capacity * size);
+	memcpy(bigger, small, *capacity / 2 * size);
 
-	return _nil;
+	return bigger;
 }
 
-// TODO: alias Element to something more appropriate
-Element *evaluate(ParseNode *stmt, State *state) {
-	khiter_t k = 0;
-	Element *left, *right, *returnValue;
-	int ret;
-	switch(stmt->sType) {
-	case sASSIGN:
-		// TODO: undeclared variables should not be added to state
-		// TODO: set in stone types, or no? (Default: no)
-		// add var to state if it doesn't exist already
-		if (!exists(state->h, stmt->children[0]->name)) {
-			// set variable type to expression's value type
-			stmt->children[0]->vType = stmt->children[1]->vType;
-			k = kh_put(32, state->h, stmt->children[0]->name, &ret);
-			// no need to evaluate variable, its value is being destroyed
-		} else {
-			// variable already exists in hashmap
-			k = kh_get(32, state->h, stmt->children[0]->name);
-		}
+static void pushValue(Walk *walk, Element value) {
+	if (walk->valueCount == walk->valueCapacity)
+		walk->values = grow(walk->values, walk->smallValues, &walk->valueCapacity, sizeof(Element));
 
-		kh_val(state->h, k) = evaluate(stmt->children[1], state);
-		returnValue = malloc(sizeof(Element));
-		memcpy(returnValue, kh_val(state->h, k), sizeof(Element));
+	walk->values[walk->valueCount++] = value;
+}
 
-		return returnValue;
-	case sIF:
-		// evaluate branch iff cond = true
-		returnValue = evaluate(stmt->children[0], state);
+// the value of a node with no children
+static Element leaf(ParseNode *node, State *state) {
+	Element value;
+	Slot *slot;
 
-		if (returnValue->type == tNIL)
-			return NIL;
+	STAT_INC(evaluations[node->sType]);
 
-		if (returnValue->value.boolean) {
-			// returnValue can't be nil, so free it
-			free(returnValue);
-			return evaluate(stmt->children[1], state);
-		} else {
-			// there's no else branch of the statement, so its value becomes nil
-			free(returnValue);
+	switch(node->sType) {
+	case sBOOLVAL:
+		// true/false, no evaluation
+		value.type = tBOOL;
+		value.value.boolean = node->value.boolean;
+		return value;
+	case sINT:
+	case sREAL:
+		value.type = node->vType;
+		value.value = node->value;
+		return value;
+	case sARRAY:
+	case sBIG:
+		// the literal belongs to the statement, the value gets a copy the State can hand around
+		value.type = node->vType;
+		value.value = node->value;
+		return copyValue(state, value);
+	case sVAR:
+		slot = &state->slots[node->slot];
+
+		if (state->reactive)
+			refreshSlot(state, node->slot);
+
+		// make sure variable has been assigned, if it hasn't that's a bit of a problem
+		if (!slot->defined) {
+			error(state, "Variable doesn't exist");
 			return NIL;
 		}
-	case sIFELSE:
-		// evaluate b_true if cond = true else evaluate b_false
-		returnValue = evaluate(stmt->children[0], state);
 
-		if (returnValue->type == tNIL)
-			return NIL;
+		// node->value might not be correct, obtain value from state
+		return slot->value;
+	case sPARAM:
+		return state->frame[node->slot];
+	default:
+		return NIL;
+	}
+}
+
+static Element combine(ParseNode *node, State *state, Element left, Element right) {
+	if (node->sType == sBOOL)
+		return compare(state, node->op.boolop, left, right);
+
+	return arithmetic(state, node->op.arithop, left, right);
+}
+
+// The value of a node that doesn't need the walk's stacks: a leaf, or a comparison or
+// arithmetic on two of them (which is most of them). Returns 0, having done nothing, for
+// anything else.
+static int immediate(Statement *stmt, ParseNode *node, State *state, Element *value) {
+	ParseNode *left, *right;
+	Element l;
+
+	if (stmtArity[node->sType] == 0) {
+		*value = leaf(node, state);
+		return 1;
+	}
+
+	if (node->sType != sBOOL && node->sType != sARITH)
+		return 0;
+
+	left = NODE(stmt, node->children[0]);
+	right = NODE(stmt, node->children[1]);
+
+	if (stmtArity[left->sType] != 0 || stmtArity[right->sType] != 0)
+		return 0;
+
+	STAT_INC(evaluations[node->sType]);
+
+	l = leaf(left, state);
+	*value = combine(node, state, l, leaf(right, state));
+	return 1;
+}
+
+static void pushTask(Walk *walk, NodeId id, int step) {
+	if (walk->taskCount == walk->taskCapacity)
+		walk->tasks = grow(walk->tasks, walk->smallTasks, &walk->taskCapacity, sizeof(Task));
 
-		if (returnValue->value.boolean) {
-			free(returnValue);
-			return evaluate(stmt->children[1], state);
-		} else {
-			free(returnValue);
-			return evaluate(stmt->children[2], state);
+	walk->tasks[walk->taskCount].id = id;
+	walk->tasks[walk->taskCount++].step = step;
+}
+
+// Start on a node. Its value is there straight away if it's immediate, and so is the branch
+// an if with an immediate condition takes. Otherwise it goes on the stack to be worked
+// through, along with the left hand sides below it, which are started on right away.
+static void descend(Walk *walk, Statement *stmt, NodeId id, State *state) {
+	ParseNode *node;
+	Element value;
+
+	while (1) {
+		node = NODE(stmt, id);
+
+		if ((node->sType == sIF || node->sType == sIFELSE)
+			&& immediate(stmt, NODE(stmt, node->children[0]), state, &value)) {
+			STAT_INC(evaluations[node->sType]);
+
+			// evaluate b_true if cond = true else evaluate b_false. With no else branch (or a
+			// nil condition) the statement's value becomes nil.
+			if (value.type != tNIL && isTrue(value)) {
+				id = node->children[1];
+			} else if (value.type != tNIL && node->sType == sIFELSE) {
+				id = node->children[2];
+			} else {
+				pushValue(walk, NIL);
+				return;
+			}
+
+			continue;
 		}
-	case sBOOL:
-		returnValue = malloc(sizeof(Element));
-		returnValue->type = tBOOL;
-
-		// if no children, then it's true/false, no evaluation
-		if (stmt->children == NULL) {
-			returnValue->value.boolean = stmt->value.boolean;
-			return returnValue;
+
+		if (immediate(stmt, node, state, &value)) {
+			pushValue(walk, value);
+			return;
 		}
 
-		// evaluate and store 0/1 in stmt->value
-		left = evaluate(stmt->children[0], state);
-		right = evaluate(stmt->children[1], state);
+		STAT_INC(evaluations[node->sType]);
 
-		// TODO: handle real numbers
-		switch(stmt->op.boolop) {
-		case bLESSTHAN:
-			returnValue->value.boolean = left->value.integer < right->value.integer;
-			break;
-		case bGREATERTHAN:
-			returnValue->value.boolean = left->value.integer > right->value.integer;
-			break;
-		case bEQUALTO:
-			returnValue->value.boolean = left->value.integer == right->value.integer;
-			break;
-		default:
-			// this is a bad problem
-			error("Unknown boolean operation");
+		if (node->sType != sBOOL && node->sType != sARITH) {
+			pushTask(walk, id, 0);
+			return;
+		}
 
-			free(left);
-			free(right);
-			free(returnValue);
+		pushTask(walk, id, 1);
+		id = node->children[0];
+	}
+}
 
-			return NIL;
-		}
+static void assign(Statement *stmt, NodeId var, State *state, Element value) {
+	Slot *slot;
 
-		free(left);
-		free(right);
+	if (NODE(stmt, var)->sType == sPARAM) {
+		state->frame[NODE(stmt, var)->slot] = value;
+		return;
+	}
 
-		return returnValue;
-	case sINT:
-		returnValue = malloc(sizeof(Element));
-		returnValue->type = tINT;
-		returnValue->value = stmt->value;
-		return returnValue;
-	case sVAR:
-		// make sure variable is in state, if it isn't that's a bit of a problem
-		if (!exists(state->h, stmt->name)) {
-			error("Variable doesn't exist");
-			return NIL;
-		} else {
-			// stmt->value might not be correct, obtain value from state
-			k = kh_get(32, state->h, stmt->name);
+	// evaluating never writes to the tree, a variable's type is whatever its slot holds
+	slot = &state->slots[NODE(stmt, var)->slot];
 
-			returnValue = malloc(sizeof(Element));
-			memcpy(returnValue, kh_val(state->h, k), sizeof(Element));
+	slot->value = value;
+	slot->defined = 1;
 
-			return returnValue;
-		}
-	case sARITH:
-		// TODO: handle real numbers
-		left = evaluate(stmt->children[0], state);
-		right = evaluate(stmt->children[1], state);
+	if (state->reactive)
+		slotAssigned(state, NODE(stmt, var)->slot);
+}
+
+// Run what of a loop can be run as a reduction. loop is its counter, where it stops, how big the
+// heap was when it started and its value so far. Returns 1 if that was all of it.
+static int reduce(Statement *stmt, NodeId id, State *state, Element *loop) {
+	Reduction *plan;
+	int done;
+
+	if (!worthReducing(state, loop[0].value.integer, loop[1].value.integer) || (plan = planReduction(stmt, id)) == NULL)
+		return 0;
 
-		returnValue = malloc(sizeof(Element));
-		returnValue->type = tINT;
+	done = runReduction(plan, state, &loop[0].value.integer, loop[1].value.integer, &loop[3]);
+	freeReduction(plan);
+
+	return done;
+}
 
-		switch(stmt->op.arithop) {
-		case aPLUS:
-			returnValue->value.integer = left->value.integer + right->value.integer;
+// TODO: alias Element to something more appropriate
+Element evaluate(Statement *stmt, NodeId root, State *state) {
+	Walk walk;
+	Task *task;
+	ParseNode *node;
+	Element left, right, returnValue, *loop;
+	int count;
+
+	walk.tasks = walk.smallTasks;
+	walk.taskCount = 0;
+	walk.taskCapacity = SMALL_TASKS;
+	walk.values = walk.smallValues;
+	walk.valueCount = 0;
+	walk.valueCapacity = SMALL_VALUES;
+
+	descend(&walk, stmt, root, state);
+
+	while (walk.taskCount > 0) {
+		task = &walk.tasks[walk.taskCount - 1];
+		node = NODE(stmt, task->id);
+
+		switch(node->sType) {
+		case sASSIGN:
+			if (task->step++ == 0) {
+				descend(&walk, stmt, node->children[1], state);
+				break;
+			}
+
+			walk.taskCount--;
+
+			// the value stays where it is, as the assignment's own
+			assign(stmt, node->children[0], state, walk.values[walk.valueCount - 1]);
 			break;
-		case aSUB:
-			returnValue->value.integer = left->value.integer - right->value.integer;
+		case sIF:
+		case sIFELSE:
+			if (task->step++ == 0) {
+				descend(&walk, stmt, node->children[0], state);
+				break;
+			}
+
+			returnValue = walk.values[--walk.valueCount];
+			walk.taskCount--;
+
+			// the branch takes the if's place, so a chain of them doesn't build up
+			if (returnValue.type != tNIL && isTrue(returnValue))
+				descend(&walk, stmt, node->children[1], state);
+			else if (returnValue.type != tNIL && node->sType == sIFELSE)
+				descend(&walk, stmt, node->children[2], state);
+			else
+				pushValue(&walk, NIL);
 			break;
-		case aDIV:
-			returnValue->value.integer = left->value.integer / right->value.integer;
+		case sBOOL:
+		case sARITH:
+			// the left hand side is done (descend() started on it). The right hand side is
+			// usually a leaf, arithmetic leans left, and then there's no need to wait for it.
+			if (task->step == 1 && !immediate(stmt, NODE(stmt, node->children[1]), state, &right)) {
+				task->step = 2;
+				descend(&walk, stmt, node->children[1], state);
+				break;
+			}
+
+			if (task->step == 2)
+				right = walk.values[--walk.valueCount];
+
+			left = walk.values[--walk.valueCount];
+			walk.taskCount--;
+
+			pushValue(&walk, combine(node, state, left, right));
 			break;
-		case aMULT:
-			returnValue->value.integer =  left->value.integer * right->value.integer;
+		case sDEF:
+			walk.taskCount--;
+
+			defineFunction(state, stmt, task->id);
+			pushValue(&walk, NIL);
 			break;
-		default:
-			// whoops
-			error("Unknown arithmetic operation");
+		case sLIST:
+			// each item leaves its value for the call, the rest of the list takes its place
+			if (task->step++ == 0) {
+				descend(&walk, stmt, node->children[0], state);
+				break;
+			}
 
-			free(left);
-			free(right);
-			free(returnValue);
+			walk.taskCount--;
 
-			return NIL;
+			if (NODE(stmt, node->children[1])->sType == sLIST)
+				pushTask(&walk, node->children[1], 0);
+			break;
+		case sCALL:
+			// the arguments, left to right, then the call on them
+			if (task->step++ == 0 && NODE(stmt, node->children[0])->sType == sLIST) {
+				pushTask(&walk, node->children[0], 0);
+				break;
+			}
+
+			count = (int)node->value.integer;
+			walk.taskCount--;
+			walk.valueCount -= count;
+
+			// the arguments are the frame, the call's value takes their place
+			returnValue = callFunction(state, node->slot, &walk.values[walk.valueCount], count);
+			pushValue(&walk, returnValue);
+			break;
+		case sFOR:
+			// the bounds first, they're evaluated once
+			if (task->step < 2) {
+				descend(&walk, stmt, node->children[++task->step], state);
+				break;
+			}
+
+			if (task->step == 2) {
+				task->step = 3;
+
+				if (!loopBounds(state, walk.values[walk.valueCount - 2], walk.values[walk.valueCount - 1])) {
+					walk.valueCount -= 2;
+					walk.taskCount--;
+					pushValue(&walk, NIL);
+					break;
+				}
+
+				// then the counter, where it stops, where the heap was and the body's latest value
+				pushValue(&walk, (Element){ tINT, { .integer = state->heapCount } });
+				pushValue(&walk, NIL);
+				loop = &walk.values[walk.valueCount - 4];
+
+				if (reduce(stmt, task->id, state, loop)) {
+					walk.taskCount--;
+					walk.valueCount -= 3;
+					loop[0] = loop[3];
+					break;
+				}
+			} else {
+				walk.values[walk.valueCount - 2] = walk.values[walk.valueCount - 1];
+				walk.valueCount--;
+				loop = &walk.values[walk.valueCount - 4];
+
+				if (loop[0].value.integer == loop[1].value.integer) {
+					walk.taskCount--;
+					walk.valueCount -= 3;
+					loop[0] = loop[3];
+					break;
+				}
+
+				// whatever the last iteration made and didn't keep is garbage now
+				if (COLLECTION_DUE(state))
+					collectLoopGarbage(state, (int)loop[2].value.integer, loop[3]);
+				loop[0].value.integer++;
+			}
+
+			assign(stmt, node->children[0], state, loop[0]);
+			descend(&walk, stmt, node->children[3], state);
+			break;
+		default:
+			// if you reach here you have a bad problem
+			// and you will not evaluate a statement today (or maybe ever)
+			error(state, "Fatal: unknown statement type");
+			walk.taskCount--;
+			pushValue(&walk, NIL);
+			break;
 		}
+	}
 
-		free(left);
-		free(right);
+	returnValue = walk.values[0];
 
-		return returnValue;
-	default:
-		// if you reach here you have a bad problem
-		// and you will not evaluate a statement today (or maybe ever)
-		error("Fatal: unknown statement type");
-		return NIL;
-	}
+	if (walk.tasks != walk.smallTasks)
+		free(walk.tasks);
+	if (walk.values != walk.smallValues)
+		free(walk.values);
+
+	return returnValue;
 }
 
-ParseNode *buildST(const char *input) {
-	ParseNode *stmt;
+// run bison's parser over whatever buffer the scanner has been given
+static int bisonParse(Statement *stmt, yyscan_t scanner) {
+	STAT_CLOCK(start);
+	int ok;
+
+	// error parsing
+	ok = yyparse(stmt, scanner) == 0;
+
+	if (ok)
+		foldStatement(stmt);
+
+	STAT_INC(parses);
+	STAT_ELAPSED(parseTime, start);
+
+	return ok;
+}
+
+// parse a line into stmt, reusing whatever memory the statement already has
+int bisonST(const char *input, Statement *stmt) {
 	yyscan_t scanner;
 	YY_BUFFER_STATE state;
+	int ok;
+
+	resetStatement(stmt);
 
-	if (yylex_init(&scanner)) {
+	// the lexer interns identifiers straight into the statement's name pool
+	if (yylex_init_extra(stmt, &scanner)) {
 		// couldn't initialize
-		return NULL;
+		return 0;
 	}
 
 	state = yy_scan_string(input, scanner);
+	ok = bisonParse(stmt, scanner);
 
-	if (yyparse(&stmt, scanner)) {
-		// error parsing
-		return NULL;
-	}
+	yy_delete_buffer(state, scanner);
+
+	yylex_destroy(scanner);
+
+	return ok;
+}
+
+#ifdef TERP_SCAN
+// the hand-written front end (see scan.h) reads the text where it is
+static int parse(Statement *stmt, const char *text, size_t length) {
+	STAT_CLOCK(start);
+	int ok;
+
+	resetStatement(stmt);
+	ok = scanStatement(stmt, text, length);
+
+	if (ok)
+		foldStatement(stmt);
+
+	STAT_INC(parses);
+	STAT_ELAPSED(parseTime, start);
+
+	return ok;
+}
+
+int buildST(const char *input, Statement *stmt) {
+	return parse(stmt, input, strlen(input));
+}
+
+int buildProgram(char *buffer, size_t size, Statement *stmt) {
+	return parse(stmt, buffer, size);
+}
+#else
+int buildST(const char *input, Statement *stmt) {
+	return bisonST(input, stmt);
+}
+
+int buildProgram(char *buffer, size_t size, Statement *stmt) {
+	yyscan_t scanner;
+	YY_BUFFER_STATE state;
+	int ok;
+
+	resetStatement(stmt);
+
+	if (yylex_init_extra(stmt, &scanner))
+		return 0;
+
+	// scan the buffer in place instead of letting flex copy it
+	state = yy_scan_buffer(buffer, size + 2, scanner);
+	ok = state != NULL && bisonParse(stmt, scanner);
 
 	yy_delete_buffer(state, scanner);
 
 	yylex_destroy(scanner);
 
-	return stmt;
+	return ok;
+}
+#endif
+
+void reportSyntaxError(Statement *stmt, State *state) {
+	char message[128];
+
+	if (stmt->syntaxError != NULL) {
+		snprintf(message, sizeof message, "Error: %s on line %d", stmt->syntaxError, stmt->errorLine);
+		error(state, message);
+	}
+
+	error(state, "Could not build syntax tree.");
 }
 
-Element *evaluateLine(char *line, State *state) {
-	ParseNode *stmt = buildST(line);
-	Element *val = NULL;
+// map every variable in the statement to its slot, so evaluation never hashes a name
+void resolveStatement(Statement *stmt, State *state) {
+	ParseNode *node;
+	int i;
+
+	// the tree is flat, no need to walk it
+	for (i = 0; i < stmt->count; i++) {
+		node = NODE(stmt, i);
+
+		if (node->sType == sVAR)
+			node->slot = lookupSlot(state, NAME(stmt, node));
+		else if (node->sType == sCALL)
+			node->slot = lookupFunction(state, NAME(stmt, node));
+	}
+}
+
+// compile the tree to bytecode and run it on the VM
+Element run(Statement *stmt, NodeId root, State *state) {
+	Chunk *chunk = compile(stmt, root, state);
+	Element result;
+
+	if (chunk == NULL)
+		return NIL;
+
+	result = execute(chunk, state);
+	freeChunk(chunk);
+
+	return result;
+}
+
+Element evaluateStatement(Statement *stmt, NodeId root, State *state) {
+	STAT_CLOCK(start);
+	Element result;
+
+	// the last statement's arrays and big integers are garbage unless it stored them
+	collectGarbage(state);
+
+	/* The tree-walker is kept around for differential testing */
+	if (state->treeWalk)
+		result = evaluate(stmt, root, state);
+	else
+		result = run(stmt, root, state);
+
+	if (state->reactive && NODE(stmt, root)->sType == sASSIGN)
+		defineFormula(state, stmt, root);
 
-	if (stmt == NULL) {
-		error("Could not build syntax tree.");
-		return NULL;
+	STAT_INC(statements);
+	STAT_ELAPSED(evalTime, start);
+
+	return result;
+}
+
+// evaluate one root of a cached line, compiling it the first time it runs
+// (and to native code once it has run JIT_THRESHOLD times)
+Element evaluateEntry(CacheEntry *entry, int i, State *state) {
+	STAT_CLOCK(start);
+	Statement *stmt = entry->stmt;
+	Element result = NIL;
+	Chunk *chunk;
+
+	collectGarbage(state);
+
+	if (state->treeWalk) {
+		result = evaluate(stmt, stmt->roots[i], state);
+	} else {
+		if (entry->chunks[i] == NULL)
+			entry->chunks[i] = compile(stmt, stmt->roots[i], state);
+
+		if ((chunk = entry->chunks[i]) != NULL) {
+			// only tried once, statements it can't handle just keep counting. Native code
+			// reads and writes slots directly, which reactive mode can't have.
+			if (state->jit && !state->reactive && ++chunk->runs == JIT_THRESHOLD)
+				chunk->native = jitCompile(stmt, stmt->roots[i]);
+
+			if (chunk->native == NULL || !state->jit || !jitRun(chunk->native, state, &result)) {
+				// native code that keeps bailing out only costs time, leave the statement to the VM
+				if (chunk->native != NULL && state->jit && ++chunk->bailouts == MAX_BAILOUTS) {
+					jitFree(chunk->native);
+					chunk->native = NULL;
+				}
+
+				result = execute(chunk, state);
+			}
+		}
 	}
 
-	/* Evaluate the syntax tree */
-	val = evaluate(stmt, state);
-	deleteStatement(stmt);
+	if (state->reactive && NODE(stmt, stmt->roots[i])->sType == sASSIGN)
+		defineFormula(state, stmt, stmt->roots[i]);
+
+	STAT_INC(statements);
+	STAT_ELAPSED(evalTime, start);
 
-	return val;
+	return result;
 }
 
-void freeNil() {
-	if (_nil != NULL)
-		free(_nil);
+int evaluateLine(char *line, State *state, Element *result) {
+	Statement *stmt, *recycled;
+	CacheEntry *entry = NULL;
+	int i;
+
+	// a line we've seen before skips the scanner and parser entirely
+	if (state->cache != NULL)
+		entry = cacheLookup(state->cache, line);
+
+	if (entry != NULL) {
+		stmt = entry->stmt;
+	} else {
+		stmt = state->scratch;
+
+		if (!buildST(line, stmt)) {
+			reportSyntaxError(stmt, state);
+			return 0;
+		}
+
+		resolveStatement(stmt, state);
+
+		// the cache keeps the tree, parse the next line into whatever it let go of
+		if (state->cache != NULL) {
+			entry = cacheInsert(state->cache, line, stmt, &recycled);
+			state->scratch = recycled != NULL ? recycled : newStatement();
+		}
+	}
+
+	// blank line, nothing to show for it
+	if (stmt->rootCount == 0)
+		return 0;
+
+	// a line can hold several statements, its value is the last one's
+	for (i = 0; i < stmt->rootCount; i++) {
+		if (entry != NULL)
+			*result = evaluateEntry(entry, i, state);
+		else
+			*result = evaluateStatement(stmt, stmt->roots[i], state);
+	}
+
+	return 1;
 }
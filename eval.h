@@ -4,8 +4,36 @@
 #include "stmt.h"
 #include "terp.h"
 
-Element *evaluate(ParseNode *stmt, State *state);
-Element *evaluateLine(char *line, State *state);
-void freeNil();
+#include <stddef.h>
+
+Element evaluate(Statement *stmt, NodeId node, State *state);
+
+// Bind the statement's variables to slots in state (must run before evaluating it)
+void resolveStatement(Statement *stmt, State *state);
+
+// Parse a line into stmt (resetting it first). Returns 0 on a syntax error.
+int buildST(const char *input, Statement *stmt);
+
+// buildST() with bison's front end, whichever one the build uses (the bench checks scan.c's
+// trees against it)
+int bisonST(const char *input, Statement *stmt);
+
+// Parse a whole program held in buffer, which must be followed by two NUL bytes (and be writable)
+int buildProgram(char *buffer, size_t size, Statement *stmt);
+
+// Report (to state) why stmt failed to build
+void reportSyntaxError(Statement *stmt, State *state);
+
+// Evaluate one top-level statement of a resolved tree
+Element evaluateStatement(Statement *stmt, NodeId root, State *state);
+
+struct tagCacheEntry;
+
+// Evaluate root i of a cached statement, compiling it on first use
+Element evaluateEntry(struct tagCacheEntry *entry, int i, State *state);
+
+// Parse (or fetch from the statement cache) and evaluate a line, storing the last statement's value in result.
+// Returns 0 if the line couldn't be parsed or held no statements.
+int evaluateLine(char *line, State *state, Element *result);
 
 #endif
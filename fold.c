@@ -0,0 +1,156 @@
+#include "fold.h"
+#include "stmt.h"
+#include "value.h"
+
+// replace a node with (a copy of) another one
+static void replace(Statement *stmt, NodeId id, NodeId with) {
+	*NODE(stmt, id) = *NODE(stmt, with);
+}
+
+static int isNumber(ParseNode *node) {
+	return node->sType == sINT || node->sType == sREAL;
+}
+
+static Element literal(ParseNode *node) {
+	Element e;
+
+	e.type = node->vType;
+	e.value = node->value;
+
+	return e;
+}
+
+// turn a node into the literal for a value computed at build time
+static void makeLiteral(ParseNode *node, Element value) {
+	switch(value.type) {
+	case tINT:
+		node->sType = sINT;
+		break;
+	case tREAL:
+		node->sType = sREAL;
+		break;
+	case tBOOL:
+		node->sType = sBOOLVAL;
+		break;
+	default:
+		return;
+	}
+
+	node->vType = value.type;
+	node->value = value.value;
+	node->children[0] = node->children[1] = node->children[2] = NO_NODE;
+}
+
+static int isZero(ParseNode *node) {
+	return node->sType == sREAL ? node->value.real == 0 : node->value.integer == 0;
+}
+
+static void makeNil(ParseNode *node) {
+	node->sType = sNIL;
+	node->vType = tNIL;
+	node->children[0] = node->children[1] = node->children[2] = NO_NODE;
+}
+
+static int isInt(Statement *stmt, NodeId id, int value) {
+	return NODE(stmt, id)->sType == sINT && NODE(stmt, id)->value.integer == value;
+}
+
+// Dropping "+ 0" or "* 1" is only safe when the other side is already a number (or nil):
+// a variable could hold a boolean, which arithmetic turns into an integer.
+static int isArith(Statement *stmt, NodeId id) {
+	return NODE(stmt, id)->sType == sARITH;
+}
+
+static void foldArith(Statement *stmt, NodeId id) {
+	ParseNode *node = NODE(stmt, id);
+	NodeId l = node->children[0], r = node->children[1];
+	Element result;
+
+	if (isNumber(NODE(stmt, l)) && isNumber(NODE(stmt, r))) {
+		// division by zero is left for the evaluator to complain about
+		if (node->op.arithop == aDIV && isZero(NODE(stmt, r)))
+			return;
+
+		// same arithmetic as the evaluator, so folding can't change a result (a big result is
+		// left for the evaluator too, literals that need memory aren't worth making here)
+		result = arithmetic(NULL, node->op.arithop, literal(NODE(stmt, l)), literal(NODE(stmt, r)));
+
+		if (result.type == tBIG)
+			freeValue(result);
+		else
+			makeLiteral(node, result);
+		return;
+	}
+
+	switch(node->op.arithop) {
+	case aPLUS:
+		// x + 0 isn't x for a real x = -0.0, so only do it when x is known to be an integer
+		if (isInt(stmt, r, 0) && isArith(stmt, l) && NODE(stmt, l)->vType == tINT)
+			replace(stmt, id, l);
+		else if (isInt(stmt, l, 0) && isArith(stmt, r) && NODE(stmt, r)->vType == tINT)
+			replace(stmt, id, r);
+		return;
+	case aSUB:
+		if (isInt(stmt, r, 0) && isArith(stmt, l))
+			replace(stmt, id, l);
+		return;
+	case aMULT:
+		if (isInt(stmt, r, 1) && isArith(stmt, l))
+			replace(stmt, id, l);
+		else if (isInt(stmt, l, 1) && isArith(stmt, r))
+			replace(stmt, id, r);
+		return;
+	case aDIV:
+		if (isInt(stmt, r, 1) && isArith(stmt, l))
+			replace(stmt, id, l);
+		return;
+	default:
+		return;
+	}
+}
+
+static void foldBool(Statement *stmt, NodeId id) {
+	ParseNode *node = NODE(stmt, id);
+	ParseNode *l = NODE(stmt, node->children[0]), *r = NODE(stmt, node->children[1]);
+
+	if (isNumber(l) && isNumber(r))
+		makeLiteral(node, compare(NULL, node->op.boolop, literal(l), literal(r)));
+}
+
+static void foldIf(Statement *stmt, NodeId id) {
+	ParseNode *node = NODE(stmt, id);
+	ParseNode *cond = NODE(stmt, node->children[0]);
+
+	if (cond->sType != sBOOLVAL)
+		return;
+
+	if (cond->value.boolean)
+		replace(stmt, id, node->children[1]);
+	else if (node->sType == sIFELSE)
+		replace(stmt, id, node->children[2]);
+	else
+		makeNil(node);
+}
+
+void foldStatement(Statement *stmt) {
+	NodeId id;
+
+	// the parser builds children before their parents, so one pass in
+	// index order sees every subtree already folded
+	for (id = 0; id < stmt->count; id++) {
+		switch(NODE(stmt, id)->sType) {
+		case sARITH:
+			foldArith(stmt, id);
+			break;
+		case sBOOL:
+			foldBool(stmt, id);
+			break;
+		case sIF:
+		case sIFELSE:
+			foldIf(stmt, id);
+			break;
+		default:
+			break;
+		}
+	}
+}
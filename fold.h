@@ -0,0 +1,10 @@
+#ifndef __FOLD_H__
+#define __FOLD_H__
+
+#include "stmt.h"
+
+// Fold constant subexpressions, drop identity operations and prune branches whose
+// condition is a constant. Runs in place; nodes that stop being referenced are just left behind.
+void foldStatement(Statement *stmt);
+
+#endif
@@ -0,0 +1,368 @@
+#include "function.h"
+#include "eval.h"
+#include "vm.h"
+#include "value.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// a key this many arguments long is kept on the C stack while the call runs
+#define SMALL_KEY 8
+
+int lookupFunction(State *state, const char *name) {
+	int created;
+	int *index = symbolInsert(state->functionNames, name, &created);
+
+	if (!created)
+		return *index;
+
+	if (state->functionCount == state->functionCapacity) {
+		state->functionCapacity = state->functionCapacity ? state->functionCapacity * 2 : 8;
+		state->functions = (UserFunction *)realloc(state->functions, state->functionCapacity * sizeof(UserFunction));
+	}
+
+	memset(&state->functions[state->functionCount], 0, sizeof(UserFunction));
+
+	*index = state->functionCount;
+	return state->functionCount++;
+}
+
+// a function without parameters only ever has one call to remember
+static int memoSize(UserFunction *function) {
+	return function->paramCount > 0 ? MEMO_SIZE : 1;
+}
+
+static void clearMemo(UserFunction *function) {
+	int i;
+
+	for (i = 0; function->memo != NULL && i < memoSize(function); i++) {
+		if (function->memo[i].used)
+			freeValue(function->memo[i].result);
+	}
+
+	free(function->memo);
+	free(function->keys);
+	function->memo = NULL;
+	function->keys = NULL;
+}
+
+// forget a definition, keeping the counters
+static void undefine(UserFunction *function) {
+	clearMemo(function);
+	deleteStatement(function->definition);
+	deleteStatement(function->body);
+	freeChunk(function->chunk);
+	free(function->callees);
+
+	function->defined = 0;
+	function->definition = function->body = NULL;
+	function->chunk = NULL;
+	function->callees = NULL;
+	function->calleeCount = 0;
+	function->local = function->pure = 0;
+}
+
+// A function is pure if its body is and everything it calls is too. Recursion is fine, so
+// start from every function with a pure body and strike out the callers of impure ones
+// until nothing changes.
+static void updatePurity(State *state) {
+	UserFunction *function;
+	int changed = 1, i, j;
+
+	for (i = 0; i < state->functionCount; i++) {
+		function = &state->functions[i];
+		function->pure = function->defined && function->local;
+
+		// any definition can change what a call returns
+		clearMemo(function);
+	}
+
+	while (changed) {
+		changed = 0;
+
+		for (i = 0; i < state->functionCount; i++) {
+			function = &state->functions[i];
+
+			for (j = 0; j < function->calleeCount && function->pure; j++) {
+				if (!state->functions[function->callees[j]].pure) {
+					function->pure = 0;
+					changed = 1;
+				}
+			}
+		}
+	}
+}
+
+// which parameter a name is, -1 if it isn't one
+static int parameter(Statement *stmt, NodeId params, const char *name) {
+	ParseNode *list;
+	int i;
+
+	for (i = 0; (list = NODE(stmt, params))->sType == sLIST; i++, params = list->children[1]) {
+		if (strcmp(NAME(stmt, NODE(stmt, list->children[0])), name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+void defineFunction(State *state, Statement *stmt, NodeId def) {
+	Statement *definition = newStatement(), *body = newStatement();
+	ParseNode *node;
+	UserFunction *function;
+	int *callees = NULL, calleeCount = 0, local = 1, nested = 0, index, i;
+
+	addRoot(definition, copySubtree(definition, stmt, def));
+	def = definition->roots[0];
+	addRoot(body, copySubtree(body, definition, NODE(definition, def)->children[1]));
+
+	// the body is copied children first, so an assignment's variable has been resolved by
+	// the time the assignment is looked at
+	for (i = 0; i < body->count; i++) {
+		node = NODE(body, i);
+
+		switch(node->sType) {
+		case sVAR:
+			if ((node->slot = parameter(definition, NODE(definition, def)->children[0], NAME(body, node))) >= 0) {
+				node->sType = sPARAM;
+			} else {
+				node->slot = lookupSlot(state, NAME(body, node));
+				local = 0;
+			}
+			break;
+		case sASSIGN:
+		case sFOR:
+			if (NODE(body, node->children[0])->sType != sPARAM)
+				local = 0;
+			break;
+		case sCALL:
+			node->slot = lookupFunction(state, NAME(body, node));
+
+			callees = (int *)realloc(callees, (calleeCount + 1) * sizeof(int));
+			callees[calleeCount++] = node->slot;
+			break;
+		case sDEF:
+			nested = 1;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// a call that redefined a function could pull the body it's running out from under it
+	if (nested) {
+		error(state, "Functions can't be defined inside functions");
+
+		deleteStatement(definition);
+		deleteStatement(body);
+		free(callees);
+		return;
+	}
+
+	index = lookupFunction(state, NAME(definition, NODE(definition, def)));
+	function = &state->functions[index];
+	undefine(function);
+
+	function->defined = 1;
+	function->paramCount = NODE(definition, def)->value.integer;
+	function->definition = definition;
+	function->body = body;
+	function->callees = callees;
+	function->calleeCount = calleeCount;
+	function->local = local;
+
+	updatePurity(state);
+}
+
+static int memoizable(Element *args, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (args[i].type != tNIL && args[i].type != tBOOL && args[i].type != tINT && args[i].type != tREAL)
+			return 0;
+	}
+
+	return 1;
+}
+
+static uint64_t bitsOf(Element e) {
+	switch(e.type) {
+	case tNIL:
+		return 0;
+	case tBOOL:
+		return (uint64_t)e.value.boolean;
+	default:
+		return (uint64_t)e.value.integer;
+	}
+}
+
+static uint64_t hashArgs(Element *args, int count) {
+	uint64_t h = 0x9e3779b97f4a7c15ULL;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		h = (h ^ args[i].type) * 0xff51afd7ed558ccdULL;
+		h = (h ^ bitsOf(args[i])) * 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 29;
+	}
+
+	return h ^ (h >> 32);
+}
+
+// where a memo entry's arguments are kept (nowhere, for a function without any)
+static Element *keyOf(UserFunction *function, MemoEntry *entry) {
+	return function->keys != NULL ? function->keys + (entry - function->memo) * function->paramCount : NULL;
+}
+
+static int sameArgs(Element *keys, Element *args, int count) {
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (keys[i].type != args[i].type || bitsOf(keys[i]) != bitsOf(args[i]))
+			return 0;
+	}
+
+	return 1;
+}
+
+Element callFunction(State *state, int index, Element *args, int count) {
+	UserFunction *function = &state->functions[index];
+	Element small[SMALL_KEY], *key = NULL, *frame = state->frame, result;
+	MemoEntry *entry;
+	uint64_t hash = 0;
+	int errors = state->errors, frameSize = state->frameSize;
+
+	if (!function->defined) {
+		error(state, "Function doesn't exist");
+		return NIL;
+	}
+
+	if (count != function->paramCount) {
+		error(state, "Wrong number of arguments");
+		return NIL;
+	}
+
+	if (state->callDepth == MAX_CALL_DEPTH) {
+		error(state, "Too much recursion");
+		return NIL;
+	}
+
+	function->calls++;
+
+	if (function->pure && memoizable(args, count) && function->memo == NULL) {
+		function->memo = (MemoEntry *)calloc(memoSize(function), sizeof(MemoEntry));
+
+		if (count > 0)
+			function->keys = (Element *)malloc(MEMO_SIZE * count * sizeof(Element));
+
+		// without the memory for a memo, calls are just made every time
+		if (function->memo == NULL || (count > 0 && function->keys == NULL))
+			clearMemo(function);
+	}
+
+	if (function->pure && memoizable(args, count) && function->memo != NULL) {
+		hash = hashArgs(args, count);
+		entry = &function->memo[hash & (memoSize(function) - 1)];
+
+		if (entry->used && entry->hash == hash && sameArgs(keyOf(function, entry), args, count)) {
+			function->hits++;
+			return copyValue(state, entry->result);
+		}
+
+		function->misses++;
+
+		// the body can assign to its parameters, so the key is what they were to begin with
+		key = count <= SMALL_KEY ? small : (Element *)malloc(count * sizeof(Element));
+
+		if (key != NULL)
+			memcpy(key, args, count * sizeof(Element));
+	}
+
+	state->frame = args;
+	state->frameSize = count;
+	state->callDepth++;
+
+	if (state->treeWalk) {
+		result = evaluate(function->body, function->body->roots[0], state);
+	} else {
+		if (function->chunk == NULL)
+			function->chunk = compile(function->body, function->body->roots[0], state);
+
+		result = function->chunk != NULL ? execute(function->chunk, state) : NIL;
+	}
+
+	state->callDepth--;
+	state->frame = frame;
+	state->frameSize = frameSize;
+
+	// a call that reported an error is left to report it again next time
+	if (key != NULL && state->errors == errors) {
+		entry = &function->memo[hash & (memoSize(function) - 1)];
+
+		if (entry->used) {
+			freeValue(entry->result);
+			function->evictions++;
+		}
+
+		entry->used = 1;
+		entry->hash = hash;
+		entry->result = copyValue(NULL, result);
+
+		if (count > 0)
+			memcpy(keyOf(function, entry), key, count * sizeof(Element));
+	}
+
+	if (key != small)
+		free(key);
+
+	return result;
+}
+
+void copyFunctions(State *to, State *from) {
+	int i;
+
+	for (i = 0; i < from->functionCount; i++) {
+		if (from->functions[i].defined)
+			defineFunction(to, from->functions[i].definition, from->functions[i].definition->roots[0]);
+	}
+}
+
+void freeFunctions(State *state) {
+	int i;
+
+	for (i = 0; i < state->functionCount; i++)
+		undefine(&state->functions[i]);
+
+	free(state->functions);
+	freeSymbolTable(state->functionNames);
+}
+
+void printFunctionStats(FILE *out, State *state) {
+	UserFunction *function;
+	Symbol *symbol;
+	unsigned long lookups;
+	int i, shown = 0;
+
+	for (i = symbolNext(state->functionNames, -1); i >= 0; i = symbolNext(state->functionNames, i)) {
+		symbol = &state->functionNames->symbols[i];
+		function = &state->functions[symbol->value];
+
+		if (!function->defined)
+			continue;
+
+		fprintf(out, "%s: %d parameters, %lu calls", symbol->key, function->paramCount, function->calls);
+
+		if (function->pure) {
+			lookups = function->hits + function->misses;
+			fprintf(out, ", pure: %lu hits, %lu misses, %lu evictions (%.1f%% hit rate)\n", function->hits,
+				function->misses, function->evictions, lookups ? 100.0 * function->hits / lookups : 0.0);
+		} else {
+			fprintf(out, ", not pure\n");
+		}
+
+		shown++;
+	}
+
+	if (shown == 0)
+		fprintf(out, "no functions defined\n");
+}
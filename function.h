@@ -0,0 +1,80 @@
+#ifndef __FUNCTION_H__
+#define __FUNCTION_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+// `def name(a, b) = statement` defines a function, `name(x, y)` calls it. Parameters are the
+// only local variables: any other name in the body is the global one. A function whose body
+// reads nothing but its parameters, assigns to no global and only calls other such functions
+// is pure, and its calls are memoized by argument values.
+
+// entries in each pure function's memo (a power of two)
+#define MEMO_SIZE 1024
+
+// calls can be nested this deep before they're stopped, each one takes some C stack
+#define MAX_CALL_DEPTH 1000
+
+// a remembered call: its arguments are the function's keys[index * paramCount...]
+typedef struct tagMemoEntry {
+	uint64_t hash;
+	int used;
+
+	// owned by the memo, a copy is handed out
+	Element result;
+} MemoEntry;
+
+typedef struct tagUserFunction {
+	// calls are resolved before they run, so there can be an entry for a name that hasn't
+	// been defined (yet)
+	int defined;
+	int paramCount;
+
+	// the definition, kept to give a session started from this one the same functions
+	Statement *definition;
+
+	// the body on its own, resolved against the frame and the State, and its bytecode
+	// (compiled on its first call)
+	Statement *body;
+	struct tagChunk *chunk;
+
+	// functions the body calls
+	int *callees;
+	int calleeCount;
+
+	// whether the body on its own is pure, and whether everything it calls is too
+	int local;
+	int pure;
+
+	// MEMO_SIZE entries (one without parameters) and their keys (NULL without parameters),
+	// allocated on the first pure call
+	MemoEntry *memo;
+	Element *keys;
+
+	unsigned long calls;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+} UserFunction;
+
+// Find the function with a name, creating an undefined entry on first sight
+int lookupFunction(State *state, const char *name);
+
+// Run a definition (an sDEF node), replacing whatever the function was
+void defineFunction(State *state, Statement *stmt, NodeId def);
+
+// Call a function with count arguments, which stay where they are as its frame
+Element callFunction(State *state, int function, Element *args, int count);
+
+// Give to every function defined in from to to as well
+void copyFunctions(State *to, State *from);
+
+// What :functions shows: each defined function's calls and, if it's pure, how its memo is doing
+void printFunctionStats(FILE *out, State *state);
+
+void freeFunctions(State *state);
+
+#endif
@@ -0,0 +1,343 @@
+#include "image.h"
+#include "stmt.h"
+#include "terp.h"
+#include "symtab.h"
+#include "array.h"
+#include "bigint.h"
+#include "value.h"
+#include "reactive.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// an image being built in memory, before it's written out in one go
+typedef struct tagWriter {
+	char *data;
+	size_t length;
+	size_t capacity;
+} Writer;
+
+// append n bytes (8 byte aligned, so payloads can be read in place), returns their offset
+static uint64_t append(Writer *w, const void *bytes, size_t n) {
+	uint64_t offset = (w->length + 7) & ~(size_t)7;
+
+	while (offset + n > w->capacity) {
+		w->capacity = w->capacity ? w->capacity * 2 : 4096;
+		w->data = realloc(w->data, w->capacity);
+	}
+
+	memset(w->data + w->length, 0, offset - w->length);
+	if (bytes != NULL)
+		memcpy(w->data + offset, bytes, n);
+	else
+		memset(w->data + offset, 0, n);
+
+	w->length = offset + n;
+	return offset;
+}
+
+static uint64_t appendPayload(Writer *w, uint32_t kind, uint32_t length, const void *data, size_t size) {
+	ImagePayload payload = { kind, length };
+	uint64_t offset = append(w, &payload, sizeof payload);
+
+	append(w, data, size);
+	return offset;
+}
+
+// add a variable to the table, which was sized so there's always an empty bucket
+static void place(Writer *w, uint32_t capacity, const char *name, Element value) {
+	ImageBucket bucket = { 0 };
+	ImageBucket *buckets;
+	uint32_t i;
+
+	bucket.nameLength = strlen(name);
+	bucket.hash = symbolHash(name, bucket.nameLength);
+	bucket.name = append(w, name, bucket.nameLength + 1);
+	bucket.type = value.type;
+
+	switch(value.type) {
+	case tINT:
+		bucket.value = (uint64_t)value.value.integer;
+		break;
+	case tREAL:
+		memcpy(&bucket.value, &value.value.real, sizeof(double));
+		break;
+	case tBOOL:
+		bucket.value = value.value.boolean;
+		break;
+	case tSET:
+		bucket.value = appendPayload(w, value.value.array->type, value.value.array->length,
+			value.value.array->data, dataSize(value.value.array->type, value.value.array->length));
+		break;
+	case tBIG:
+		bucket.value = appendPayload(w, value.value.big->negative, value.value.big->length,
+			value.value.big->limbs, value.value.big->length * sizeof(uint32_t));
+		break;
+	default:
+		bucket.type = tNIL;
+		break;
+	}
+
+	// appending may have moved the buffer
+	buckets = (ImageBucket *)(w->data + ((ImageHeader *)w->data)->buckets);
+
+	for (i = bucket.hash & (capacity - 1); buckets[i].name != 0; i = (i + 1) & (capacity - 1))
+		;
+
+	buckets[i] = bucket;
+}
+
+// the payload a bucket points at, NULL if it runs off the end of the image
+static const ImagePayload *payloadOf(Image *image, const ImageBucket *bucket, size_t elementSize) {
+	const ImagePayload *payload;
+
+	if (bucket->value + sizeof(ImagePayload) > image->size)
+		return NULL;
+
+	payload = (const ImagePayload *)(image->data + bucket->value);
+
+	if (bucket->value + sizeof(ImagePayload) + (uint64_t)payload->length * elementSize > image->size)
+		return NULL;
+
+	return payload;
+}
+
+// a bucket's value, with arrays and big integers copied out of the image; 0 if it's damaged
+static int decode(Image *image, const ImageBucket *bucket, State *state, Element *value) {
+	const ImagePayload *payload;
+	Array *array;
+
+	value->type = bucket->type;
+
+	switch(bucket->type) {
+	case tINT:
+		value->value.integer = (int64_t)bucket->value;
+		return 1;
+	case tREAL:
+		memcpy(&value->value.real, &bucket->value, sizeof(double));
+		return 1;
+	case tBOOL:
+		value->value.boolean = (int)bucket->value;
+		return 1;
+	case tNIL:
+		return 1;
+	case tSET:
+		// a mask's length is in bits, so this only checks a lower bound for it
+		if ((payload = payloadOf(image, bucket, 0)) == NULL || payload->kind > eMASK)
+			return 0;
+		if (bucket->value + sizeof *payload + dataSize(payload->kind, payload->length) > image->size)
+			return 0;
+
+		array = newArray(payload->kind, payload->length);
+		memcpy(array->data, payload + 1, dataSize(array->type, array->length));
+
+		value->value.array = array;
+		*value = keepValue(state, *value);
+		return 1;
+	case tBIG:
+		if ((payload = payloadOf(image, bucket, sizeof(uint32_t))) == NULL)
+			return 0;
+
+		value->value.big = bigFromLimbs((const uint32_t *)(payload + 1), payload->length, payload->kind);
+		*value = keepValue(state, *value);
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+// a bucket's name, NULL for an empty bucket (or one whose name runs off the end, or isn't
+// exactly nameLength characters and a terminator)
+static const char *nameOf(Image *image, const ImageBucket *bucket) {
+	const char *name;
+
+	if (bucket->name == 0 || bucket->name + bucket->nameLength >= image->size)
+		return NULL;
+
+	name = image->data + bucket->name;
+
+	// with the terminator where it should be, strlen() can't run past it
+	if (name[bucket->nameLength] != '\0' || strlen(name) != bucket->nameLength)
+		return NULL;
+
+	return name;
+}
+
+static const ImageBucket *find(Image *image, const char *name) {
+	uint32_t length = strlen(name), hash = symbolHash(name, length);
+	uint32_t mask = image->header->capacity - 1, i, probes;
+	const ImageBucket *bucket;
+
+	for (i = hash & mask, probes = 0; probes < image->header->capacity; i = (i + 1) & mask, probes++) {
+		bucket = &image->buckets[i];
+
+		if (bucket->name == 0)
+			return NULL;
+
+		if (bucket->hash == hash && bucket->nameLength == length && nameOf(image, bucket) != NULL
+			&& memcmp(nameOf(image, bucket), name, length) == 0)
+			return bucket;
+	}
+
+	return NULL;
+}
+
+int imageLookup(Image *image, State *state, const char *name, Element *value) {
+	const ImageBucket *bucket = find(image, name);
+
+	if (bucket == NULL)
+		return 0;
+
+	if (value != NULL && !decode(image, bucket, state, value)) {
+		error(state, "Image is damaged");
+		*value = NIL;
+	}
+
+	return 1;
+}
+
+int saveImage(State *state, const char *file) {
+	ImageHeader header = { IMAGE_MAGIC, IMAGE_VERSION, IMAGE_BYTE_ORDER };
+	Writer w = { 0 };
+	SymbolTable *symbols = state->symbols;
+	Image *image = state->image;
+	const ImageBucket *bucket;
+	const char *name;
+	Element value;
+	char *temp;
+	FILE *out;
+	uint32_t count = 0, i;
+	uint64_t offset;
+	int index, ok;
+
+	// the State's own variables, and the ones still only in the image it was started from
+	for (index = symbolNext(symbols, -1); index >= 0; index = symbolNext(symbols, index)) {
+		// values go out as they'd be read, not as they were when something they're defined by changed
+		refreshSlot(state, symbols->symbols[index].value);
+		count += state->slots[symbols->symbols[index].value].defined;
+	}
+
+	for (i = 0; image != NULL && i < image->header->capacity; i++) {
+		name = nameOf(image, &image->buckets[i]);
+		count += name != NULL && symbolLookup(symbols, name) == NULL;
+	}
+
+	// at most half full, so probes stay short
+	header.capacity = 16;
+	while (header.capacity < count * 2)
+		header.capacity *= 2;
+
+	header.count = count;
+
+	append(&w, &header, sizeof header);
+	offset = append(&w, NULL, header.capacity * sizeof(ImageBucket));
+	((ImageHeader *)w.data)->buckets = offset;
+
+	for (index = symbolNext(symbols, -1); index >= 0; index = symbolNext(symbols, index)) {
+		if (state->slots[symbols->symbols[index].value].defined)
+			place(&w, header.capacity, symbols->symbols[index].key, state->slots[symbols->symbols[index].value].value);
+	}
+
+	for (i = 0; image != NULL && i < image->header->capacity; i++) {
+		bucket = &image->buckets[i];
+		name = nameOf(image, bucket);
+
+		if (name == NULL || symbolLookup(symbols, name) != NULL)
+			continue;
+
+		// copied out and back in, it's only a page or two
+		if (decode(image, bucket, NULL, &value)) {
+			place(&w, header.capacity, name, value);
+			freeValue(value);
+		}
+	}
+
+	((ImageHeader *)w.data)->size = w.length;
+
+	// written beside the old image and moved over it, so a failed save leaves that intact
+	temp = malloc(strlen(file) + 5);
+	sprintf(temp, "%s.tmp", file);
+
+	out = fopen(temp, "wb");
+	ok = out != NULL && fwrite(w.data, 1, w.length, out) == w.length;
+	ok = out != NULL && fclose(out) == 0 && ok;
+	ok = ok && rename(temp, file) == 0;
+
+	if (!ok) {
+		unlink(temp);
+		error(state, "Could not write image");
+	}
+
+	free(temp);
+	free(w.data);
+
+	return ok;
+}
+
+Image *openImage(State *state, const char *file) {
+	struct stat info;
+	const ImageHeader *header;
+	Image *image;
+	void *data;
+	int fd = open(file, O_RDONLY);
+
+	if (fd < 0) {
+		error(state, "Could not open image");
+		return NULL;
+	}
+
+	if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(ImageHeader)) {
+		close(fd);
+		error(state, "Not an image");
+		return NULL;
+	}
+
+	data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		error(state, "Could not open image");
+		return NULL;
+	}
+
+	header = data;
+
+	if (memcmp(header->magic, IMAGE_MAGIC, sizeof header->magic) != 0 || header->byteOrder != IMAGE_BYTE_ORDER
+		|| header->size != (uint64_t)info.st_size || header->capacity == 0
+		|| (header->capacity & (header->capacity - 1)) != 0
+		|| header->buckets + (uint64_t)header->capacity * sizeof(ImageBucket) > header->size) {
+		munmap(data, info.st_size);
+		error(state, "Not an image");
+		return NULL;
+	}
+
+	if (header->version != IMAGE_VERSION) {
+		munmap(data, info.st_size);
+		error(state, "Image is in a different image format");
+		return NULL;
+	}
+
+	// lookups jump around, reading ahead would only pull in pages nobody asked for
+	madvise(data, info.st_size, MADV_RANDOM);
+
+	image = malloc(sizeof(Image));
+	image->data = data;
+	image->size = info.st_size;
+	image->header = header;
+	image->buckets = (const ImageBucket *)(image->data + header->buckets);
+
+	return image;
+}
+
+void closeImage(Image *image) {
+	if (image == NULL)
+		return;
+
+	munmap((void *)image->data, image->size);
+	free(image);
+}
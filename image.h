@@ -0,0 +1,77 @@
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+#include <stdint.h>
+
+// An image is a State's variables saved to a file that can be mapped straight back in.
+// Everything in it is addressed by offset from the start of the file, so it can be mapped
+// anywhere. A hash table of buckets comes first, then the names and the contents of arrays
+// and big integers; a lookup touches one bucket and whatever it points at, so only the
+// pages holding variables that are actually used ever get read.
+#define IMAGE_MAGIC "terpimg"
+#define IMAGE_VERSION 1
+
+// written as is, so an image from a machine with the other byte order is rejected
+#define IMAGE_BYTE_ORDER 0x01020304
+
+typedef struct tagImageHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+
+	// size of the whole file
+	uint64_t size;
+
+	// buckets in the table (a power of two) and variables in it
+	uint32_t capacity;
+	uint32_t count;
+	uint64_t buckets;
+} ImageHeader;
+
+typedef struct tagImageBucket {
+	// symbolHash() of the name; linear probing from hash & (capacity - 1)
+	uint32_t hash;
+	uint32_t nameLength;
+
+	// offset of the NUL-terminated name, 0 for an empty bucket
+	uint64_t name;
+
+	// a ValueType; ints, reals and booleans are stored in value, arrays and big integers
+	// are at offset value (see ImagePayload)
+	uint32_t type;
+	uint32_t unused;
+	uint64_t value;
+} ImageBucket;
+
+// what an array or big integer's value points at, followed by its elements or limbs
+typedef struct tagImagePayload {
+	// ElemType for arrays, sign for big integers
+	uint32_t kind;
+	uint32_t length;
+} ImagePayload;
+
+typedef struct tagImage {
+	const char *data;
+	uint64_t size;
+
+	const ImageHeader *header;
+	const ImageBucket *buckets;
+} Image;
+
+// Write every defined variable in state (including ones it hasn't touched yet in its own
+// image) to file. Returns 0, after reporting why to state, if it can't.
+int saveImage(State *state, const char *file);
+
+// Map an image file, NULL (after reporting why to state) if it can't be read or isn't one
+// this version understands
+Image *openImage(State *state, const char *file);
+void closeImage(Image *image);
+
+// Find a variable in an image. If it's there and value isn't NULL, its value is copied out
+// (arrays and big integers become state's). Returns 0 if there's no such variable.
+int imageLookup(Image *image, State *state, const char *name, Element *value);
+
+#endif
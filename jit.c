@@ -0,0 +1,387 @@
+#include "jit.h"
+#include "stmt.h"
+#include "terp.h"
+#include "stats.h"
+
+#include <stdlib.h>
+
+#if defined(__x86_64__) && defined(__unix__)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// generated code is called as int f(Slot *slots, int64_t *result), returning 0 to bail out
+typedef int (*NativeFunction)(Slot *slots, int64_t *result);
+
+struct tagJitCode {
+	NativeFunction function;
+
+	// the mapping holding the code
+	void *memory;
+	size_t size;
+
+	// type of the statement's value, known when it was compiled
+	ValueType type;
+};
+
+typedef struct tagAssembler {
+	Statement *stmt;
+
+	unsigned char *code;
+	int count;
+	int capacity;
+
+	// offsets of the rel32 fields of jumps to the bailout, patched at the end
+	int *bailouts;
+	int bailCount;
+	int bailCapacity;
+} Assembler;
+
+// condition codes for Jcc and SETcc
+#define CC_O 0x0
+#define CC_E 0x4
+#define CC_NE 0x5
+#define CC_L 0xc
+#define CC_G 0xf
+
+// the Slot fields generated code touches, as displacements from rdi
+#define TYPE_OF(slot) ((int32_t)((slot) * sizeof(Slot) + offsetof(Slot, value) + offsetof(Element, type)))
+#define VALUE_OF(slot) ((int32_t)((slot) * sizeof(Slot) + offsetof(Slot, value) + offsetof(Element, value)))
+#define DEFINED_OF(slot) ((int32_t)((slot) * sizeof(Slot) + offsetof(Slot, defined)))
+
+// keeps every displacement inside 32 bits
+#define MAX_SLOT 1000000
+
+static void emitByte(Assembler *a, int b) {
+	if (a->count == a->capacity) {
+		a->capacity = a->capacity ? a->capacity * 2 : 256;
+		a->code = realloc(a->code, a->capacity);
+	}
+
+	a->code[a->count++] = (unsigned char)b;
+}
+
+static void emitBytes(Assembler *a, const char *bytes, int n) {
+	int i;
+
+	for (i = 0; i < n; i++)
+		emitByte(a, (unsigned char)bytes[i]);
+}
+
+static void emit32(Assembler *a, int32_t value) {
+	int i;
+
+	// little endian
+	for (i = 0; i < 4; i++)
+		emitByte(a, ((uint32_t)value >> (i * 8)) & 0xff);
+}
+
+// jcc rel32 to the bailout
+static void bailIf(Assembler *a, int cc) {
+	emitByte(a, 0x0f);
+	emitByte(a, 0x80 | cc);
+
+	if (a->bailCount == a->bailCapacity) {
+		a->bailCapacity = a->bailCapacity ? a->bailCapacity * 2 : 8;
+		a->bailouts = realloc(a->bailouts, a->bailCapacity * sizeof(int));
+	}
+
+	a->bailouts[a->bailCount++] = a->count;
+	emit32(a, 0);
+}
+
+// the children whose code goes before a node's, which leaves their values on the machine
+// stack: first up to (not including) last
+static void operands(ParseNode *node, int *first, int *last) {
+	switch(node->sType) {
+	case sARITH:
+	case sBOOL:
+		*first = 0;
+		*last = 2;
+		break;
+	case sASSIGN:
+		*first = 1;
+		*last = 2;
+		break;
+	default:
+		*first = *last = 0;
+		break;
+	}
+}
+
+// Emit code leaving the node's value pushed on the machine stack, once its operands' code
+// (of the types in types) has been emitted. Returns the value's type, or tNIL if the node
+// can't be compiled.
+static ValueType compileNode(Assembler *a, ParseNode *node, const ValueType *types) {
+	ValueType type;
+	int slot;
+
+	switch(node->sType) {
+	case sINT:
+		if (node->value.integer == (int32_t)node->value.integer) {
+			// push imm32 (sign extended)
+			emitByte(a, 0x68);
+			emit32(a, (int32_t)node->value.integer);
+		} else {
+			// mov rax, imm64; push rax
+			emitBytes(a, "\x48\xb8", 2);
+			emit32(a, (int32_t)node->value.integer);
+			emit32(a, (int32_t)(node->value.integer >> 32));
+			emitByte(a, 0x50);
+		}
+		return tINT;
+	case sVAR:
+		if ((slot = node->slot) < 0 || slot > MAX_SLOT)
+			return tNIL;
+
+		// cmp dword [rdi + type], tINT; jne bail (an undefined slot holds nil, so this covers that too)
+		emitBytes(a, "\x83\xbf", 2);
+		emit32(a, TYPE_OF(slot));
+		emitByte(a, tINT);
+		bailIf(a, CC_NE);
+
+		// mov rax, [rdi + value]; push rax
+		emitBytes(a, "\x48\x8b\x87", 3);
+		emit32(a, VALUE_OF(slot));
+		emitByte(a, 0x50);
+		return tINT;
+	case sARITH:
+		if (types[0] != tINT || types[1] != tINT)
+			return tNIL;
+
+		// pop rcx; pop rax
+		emitBytes(a, "\x59\x58", 2);
+
+		// 64 bit operations, overflow is left to the interpreter (which makes a big integer)
+		switch(node->op.arithop) {
+		case aPLUS:
+			emitBytes(a, "\x48\x01\xc8", 3);		// add rax, rcx
+			bailIf(a, CC_O);
+			break;
+		case aSUB:
+			emitBytes(a, "\x48\x29\xc8", 3);		// sub rax, rcx
+			bailIf(a, CC_O);
+			break;
+		case aMULT:
+			emitBytes(a, "\x48\x0f\xaf\xc1", 4);	// imul rax, rcx
+			bailIf(a, CC_O);
+			break;
+		case aDIV:
+			// zero (an error) and -1 (can trap) are left to the interpreter
+			emitBytes(a, "\x48\x85\xc9", 3);		// test rcx, rcx
+			bailIf(a, CC_E);
+			emitBytes(a, "\x48\x83\xf9\xff", 4);	// cmp rcx, -1
+			bailIf(a, CC_E);
+			emitBytes(a, "\x48\x99\x48\xf7\xf9", 5);	// cqo; idiv rcx
+			break;
+		default:
+			return tNIL;
+		}
+
+		emitByte(a, 0x50);
+		return tINT;
+	case sBOOL:
+		if (types[0] != tINT || types[1] != tINT)
+			return tNIL;
+
+		// pop rcx; pop rax; cmp rax, rcx; setcc al; movzx eax, al; push rax
+		emitBytes(a, "\x59\x58\x48\x39\xc8\x0f", 6);
+
+		switch(node->op.boolop) {
+		case bLESSTHAN:
+			emitByte(a, 0x90 | CC_L);
+			break;
+		case bGREATERTHAN:
+			emitByte(a, 0x90 | CC_G);
+			break;
+		case bEQUALTO:
+			emitByte(a, 0x90 | CC_E);
+			break;
+		default:
+			return tNIL;
+		}
+
+		emitBytes(a, "\xc0\x0f\xb6\xc0\x50", 5);
+		return tBOOL;
+	case sASSIGN:
+		// every bailout comes before the first store, so a bailed out run has no effects
+		if ((type = types[0]) == tNIL)
+			return tNIL;
+
+		if ((slot = NODE(a->stmt, node->children[0])->slot) < 0 || slot > MAX_SLOT)
+			return tNIL;
+
+		// mov rax, [rsp]; the value stays pushed as the assignment's own value
+		emitBytes(a, "\x48\x8b\x04\x24", 4);
+
+		// mov [rdi + value], rax; mov dword [rdi + type], type; mov dword [rdi + defined], 1
+		emitBytes(a, "\x48\x89\x87", 3);
+		emit32(a, VALUE_OF(slot));
+		emitBytes(a, "\xc7\x87", 2);
+		emit32(a, TYPE_OF(slot));
+		emit32(a, type);
+		emitBytes(a, "\xc7\x87", 2);
+		emit32(a, DEFINED_OF(slot));
+		emit32(a, 1);
+		return type;
+	default:
+		return tNIL;
+	}
+}
+
+// Compile the tree under root, each node once the code for its operands is done, keeping
+// track of where we are with a stack of our own (a statement can be nested too deeply to
+// recurse over). Returns the statement's type, or tNIL if any of it can't be compiled.
+static ValueType compileTree(Assembler *a, NodeId root) {
+	// nodes part way through, and the next operand of each
+	struct { NodeId id; int next; } *path = NULL;
+	ValueType *types = NULL, type = tNIL;
+	int depth = 0, typeCount = 0, capacity = 0, first, last;
+	ParseNode *node;
+
+	do {
+		// there are never more values waiting than two for each node on the path
+		if (depth == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			path = realloc(path, capacity * sizeof *path);
+			types = (ValueType *)realloc(types, capacity * 2 * sizeof(ValueType));
+		}
+
+		node = NODE(a->stmt, root);
+		operands(node, &first, &last);
+
+		path[depth].id = root;
+		path[depth++].next = first;
+
+		// back up until some node has an operand left, which is next
+		while (depth > 0) {
+			node = NODE(a->stmt, path[depth - 1].id);
+			operands(node, &first, &last);
+
+			if (path[depth - 1].next < last) {
+				root = node->children[path[depth - 1].next++];
+				break;
+			}
+
+			typeCount -= last - first;
+
+			if ((type = compileNode(a, node, types + typeCount)) == tNIL) {
+				depth = 0;
+				break;
+			}
+
+			types[typeCount++] = type;
+			depth--;
+		}
+	} while (depth > 0);
+
+	free(path);
+	free(types);
+
+	return type;
+}
+
+JitCode *jitCompile(Statement *stmt, NodeId root) {
+	Assembler a = { stmt };
+	JitCode *code = NULL;
+	ValueType type;
+	size_t page;
+	int bail, i;
+	int32_t offset;
+
+	// push rbp; mov rbp, rsp
+	emitBytes(&a, "\x55\x48\x89\xe5", 4);
+
+	type = compileTree(&a, root);
+
+	if (type != tNIL) {
+		// pop rax; mov [rsi], rax; mov eax, 1; leave; ret
+		emitBytes(&a, "\x58\x48\x89\x06\xb8\x01\x00\x00\x00\xc9\xc3", 11);
+
+		// bail: xor eax, eax; leave; ret
+		bail = a.count;
+		emitBytes(&a, "\x31\xc0\xc9\xc3", 4);
+
+		for (i = 0; i < a.bailCount; i++) {
+			offset = bail - (a.bailouts[i] + 4);
+			memcpy(a.code + a.bailouts[i], &offset, 4);
+		}
+
+		// written while the mapping is writable, then made executable (never both at once)
+		page = sysconf(_SC_PAGESIZE);
+		code = malloc(sizeof(JitCode));
+		code->size = (a.count + page - 1) / page * page;
+		code->type = type;
+		code->memory = mmap(NULL, code->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (code->memory == MAP_FAILED) {
+			free(code);
+			code = NULL;
+		} else {
+			memcpy(code->memory, a.code, a.count);
+
+			// a W^X policy (SELinux without execmem, PaX) can refuse this, the VM keeps the statement
+			if (mprotect(code->memory, code->size, PROT_READ | PROT_EXEC) != 0) {
+				munmap(code->memory, code->size);
+				free(code);
+				code = NULL;
+			} else {
+				code->function = (NativeFunction)code->memory;
+				STAT_INC(jitCompiles);
+			}
+		}
+	}
+
+	free(a.code);
+	free(a.bailouts);
+
+	return code;
+}
+
+int jitRun(JitCode *code, State *state, Element *result) {
+	int64_t value;
+
+	if (!code->function(state->slots, &value)) {
+		STAT_INC(jitBailouts);
+		return 0;
+	}
+
+	STAT_INC(jitRuns);
+
+	result->type = code->type;
+
+	if (code->type == tBOOL)
+		result->value.boolean = (int)value;
+	else
+		result->value.integer = value;
+
+	return 1;
+}
+
+void jitFree(JitCode *code) {
+	if (code == NULL)
+		return;
+
+	munmap(code->memory, code->size);
+	free(code);
+}
+
+#else
+
+// no code generator for this machine, everything stays interpreted
+
+JitCode *jitCompile(Statement *stmt, NodeId root) {
+	return NULL;
+}
+
+int jitRun(JitCode *code, State *state, Element *result) {
+	return 0;
+}
+
+void jitFree(JitCode *code) {
+}
+
+#endif
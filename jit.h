@@ -0,0 +1,27 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+// cached statements are compiled to native code on their JIT_THRESHOLD'th run
+#define JIT_THRESHOLD 16
+
+// native code that has bailed out this often is thrown away, and the statement stays on the VM
+#define MAX_BAILOUTS 8
+
+typedef struct tagJitCode JitCode;
+
+// Compile a resolved statement to native code. Only integer arithmetic, comparisons,
+// variables, literals and assignments of them are handled; anything else (or a machine
+// that isn't x86-64) gives NULL.
+JitCode *jitCompile(Statement *stmt, NodeId root);
+
+// Run native code against state's slots. Returns 0, having changed nothing, when it meets
+// something it doesn't handle (a variable that isn't an integer, a zero or -1 divisor),
+// and the caller should evaluate the statement the normal way instead.
+int jitRun(JitCode *code, State *state, Element *result);
+
+void jitFree(JitCode *code);
+
+#endif
@@ -0,0 +1,196 @@
+#include "libterp.h"
+#include "terp.h"
+#include "eval.h"
+#include "cache.h"
+#include "value.h"
+#include "array.h"
+#include "bigint.h"
+#include "reactive.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// a program is run exactly like a cached line, its roots compiled on first use
+struct tagTerpProgram {
+	CacheEntry entry;
+};
+
+static TerpValue toValue(Element e) {
+	TerpValue value = { TERP_NIL };
+
+	switch(e.type) {
+	case tBOOL:
+		value.type = TERP_BOOL;
+		value.as.boolean = e.value.boolean;
+		break;
+	case tINT:
+		value.type = TERP_INT;
+		value.as.integer = e.value.integer;
+		break;
+	case tREAL:
+		value.type = TERP_REAL;
+		value.as.real = e.value.real;
+		break;
+	case tSET:
+		value.type = TERP_ARRAY;
+		value.object = e.value.array;
+		break;
+	case tBIG:
+		value.type = TERP_BIG;
+		value.object = e.value.big;
+		break;
+	default:
+		break;
+	}
+
+	return value;
+}
+
+static Element fromValue(TerpValue value) {
+	Element e = NIL;
+
+	switch(value.type) {
+	case TERP_BOOL:
+		e.type = tBOOL;
+		e.value.boolean = value.as.boolean;
+		break;
+	case TERP_INT:
+		e.type = tINT;
+		e.value.integer = value.as.integer;
+		break;
+	case TERP_REAL:
+		e.type = tREAL;
+		e.value.real = value.as.real;
+		break;
+	case TERP_ARRAY:
+		e.type = tSET;
+		e.value.array = (Array *)value.object;
+		break;
+	case TERP_BIG:
+		e.type = tBIG;
+		e.value.big = (BigInt *)value.object;
+		break;
+	default:
+		break;
+	}
+
+	return e;
+}
+
+Terp *terpNew(void) {
+	Terp *terp = initState();
+
+	terp->out = NULL;
+	return terp;
+}
+
+void terpFree(Terp *terp) {
+	freeState(terp);
+}
+
+void terpSetOutput(Terp *terp, FILE *out) {
+	terp->out = out;
+}
+
+int terpEval(Terp *terp, const char *source, TerpValue *result) {
+	Element value = NIL;
+	int errors = terp->errors;
+
+	// the line is only read (the scanner and the cache both take copies)
+	evaluateLine((char *)source, terp, &value);
+
+	if (result != NULL)
+		*result = toValue(value);
+
+	return terp->errors == errors;
+}
+
+TerpProgram *terpCompile(Terp *terp, const char *source) {
+	TerpProgram *program;
+	Statement *stmt = newStatement();
+
+	if (!buildST(source, stmt)) {
+		reportSyntaxError(stmt, terp);
+		deleteStatement(stmt);
+		return NULL;
+	}
+
+	resolveStatement(stmt, terp);
+
+	program = (TerpProgram *)calloc(1, sizeof(TerpProgram));
+	program->entry.stmt = stmt;
+	program->entry.chunks = (Chunk **)calloc(stmt->rootCount, sizeof(Chunk *));
+
+	return program;
+}
+
+int terpRun(Terp *terp, TerpProgram *program, TerpValue *result) {
+	Element value = NIL;
+	int errors = terp->errors, i;
+
+	for (i = 0; i < program->entry.stmt->rootCount; i++)
+		value = evaluateEntry(&program->entry, i, terp);
+
+	if (result != NULL)
+		*result = toValue(value);
+
+	return terp->errors == errors;
+}
+
+void terpFreeProgram(TerpProgram *program) {
+	int i;
+
+	if (program == NULL)
+		return;
+
+	for (i = 0; i < program->entry.stmt->rootCount; i++)
+		freeChunk(program->entry.chunks[i]);
+
+	free(program->entry.chunks);
+	deleteStatement(program->entry.stmt);
+	free(program);
+}
+
+int terpGet(Terp *terp, const char *name, TerpValue *value) {
+	int slot;
+
+	if (!exists(terp, (char *)name)) {
+		*value = toValue(NIL);
+		return 0;
+	}
+
+	// a name only the image has gets its slot now, the same as a statement reading it would
+	slot = lookupSlot(terp, name);
+	refreshSlot(terp, slot);
+
+	*value = toValue(terp->slots[slot].value);
+	return 1;
+}
+
+void terpSet(Terp *terp, const char *name, TerpValue value) {
+	int slot = lookupSlot(terp, name);
+
+	terp->slots[slot].value = copyValue(terp, fromValue(value));
+	terp->slots[slot].defined = 1;
+
+	if (terp->reactive)
+		slotAssigned(terp, slot);
+}
+
+char *terpToString(TerpValue value) {
+	char *text = NULL;
+	size_t length;
+	FILE *out = open_memstream(&text, &length);
+
+	if (out == NULL)
+		return NULL;
+
+	printValue(out, fromValue(value));
+	fclose(out);
+
+	return text;
+}
+
+const char *terpError(Terp *terp) {
+	return terp->lastError;
+}
@@ -0,0 +1,77 @@
+#ifndef __LIBTERP_H__
+#define __LIBTERP_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// terp as a library (libterp.a / libterp.so), for running code in-process instead of
+// spawning the interpreter. A Terp is one session: its variables, statement cache and
+// settings. Each is independent, so threads can have one each, but one Terp must only be
+// used by one thread at a time.
+//
+// This header is all an embedder needs; everything else in the tree is internal.
+#if defined(__GNUC__)
+#define TERP_API __attribute__((visibility("default")))
+#else
+#define TERP_API
+#endif
+
+typedef struct tagState Terp;
+
+// a parsed program, run as many times as needed in the Terp it was compiled for
+typedef struct tagTerpProgram TerpProgram;
+
+typedef enum tagTerpType {
+	TERP_NIL,
+	TERP_BOOL,
+	TERP_INT,
+	TERP_REAL,
+	TERP_ARRAY,
+	TERP_BIG
+} TerpType;
+
+typedef struct tagTerpValue {
+	TerpType type;
+
+	union {
+		int boolean;
+		int64_t integer;
+		double real;
+	} as;
+
+	// an array or big integer, owned by the Terp: good until the next call that evaluates
+	// anything in it (use terpToString() or terpSet() to keep it)
+	const void *object;
+} TerpValue;
+
+// Create a session. Errors aren't printed anywhere unless terpSetOutput() says where.
+TERP_API Terp *terpNew(void);
+TERP_API void terpFree(Terp *terp);
+
+// Where error messages are written as they happen (NULL for nowhere, the default)
+TERP_API void terpSetOutput(Terp *terp, FILE *out);
+
+// Parse and run source (any number of statements), storing the last one's value in
+// result if it isn't NULL. Source seen before is taken from the statement cache instead of
+// being parsed again. Returns 0 if it couldn't be parsed or reported an error while
+// running; terpError() says what went wrong.
+TERP_API int terpEval(Terp *terp, const char *source, TerpValue *result);
+
+// Parse source once, to run with terpRun() as often as needed. NULL on a syntax error.
+TERP_API TerpProgram *terpCompile(Terp *terp, const char *source);
+TERP_API int terpRun(Terp *terp, TerpProgram *program, TerpValue *result);
+TERP_API void terpFreeProgram(TerpProgram *program);
+
+// A variable's value; returns 0 (and sets value to nil) if it hasn't been assigned
+TERP_API int terpGet(Terp *terp, const char *name, TerpValue *value);
+
+// Assign to a variable. Arrays and big integers are copied.
+TERP_API void terpSet(Terp *terp, const char *name, TerpValue value);
+
+// Any value written out the way the REPL shows it, in a string the caller frees
+TERP_API char *terpToString(TerpValue value);
+
+// The most recent error message ("" if there hasn't been one)
+TERP_API const char *terpError(Terp *terp);
+
+#endif
@@ -0,0 +1,499 @@
+#include "loop.h"
+#include "array.h"
+#include "value.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// what a step of the expression is
+typedef enum tagStepKind {
+	rCOUNTER,
+	rNUMBER,
+	rVARIABLE,
+	rPARAMETER,
+
+	// op on two earlier steps
+	rOPERATION
+} StepKind;
+
+typedef struct tagStep {
+	StepKind kind;
+	ArithOp op;
+	int left;
+	int right;
+
+	// a number's value, a variable's or parameter's slot
+	Element number;
+	int slot;
+
+	// Worked out at the start of each run: integer or real, whether the step involves the
+	// counter (its value if it doesn't), whether a step that does reads it, and whether one
+	// reads it as a real
+	ValueType type;
+	int varies;
+	Element value;
+	int read;
+	int readAsReal;
+
+	// the least and greatest an integer step can be over the chunk
+	__int128 low;
+	__int128 high;
+
+	// a chunk's worth of the step's values, and the same converted to reals
+	void *data;
+	double *reals;
+} Step;
+
+struct tagReduction {
+	// the counter and the total: their slots, and whether they're parameters
+	int counter;
+	int counterParam;
+	int total;
+	int totalParam;
+
+	// total = total op expression, or expression + total if the total isn't first
+	ArithOp op;
+	int totalFirst;
+
+	// the expression, children before their parents, so the last step is all of it
+	Step *steps;
+	int stepCount;
+};
+
+int loopBounds(State *state, Element from, Element to) {
+	if (from.type == tNIL || to.type == tNIL)
+		return 0;
+
+	if (from.type == tBIG || to.type == tBIG) {
+		error(state, "Loop bounds must fit in 64 bits");
+		return 0;
+	}
+
+	if (from.type != tINT || to.type != tINT) {
+		error(state, "Loop bounds must be integers");
+		return 0;
+	}
+
+	STAT_INC(loops);
+	return from.value.integer <= to.value.integer;
+}
+
+int worthReducing(State *state, int64_t from, int64_t to) {
+	// in reactive mode giving the total a value can change what the other variables are
+	return !state->reactive && (uint64_t)to - (uint64_t)from >= REDUCTION_MIN - 1;
+}
+
+static int sameVariable(ParseNode *a, ParseNode *b) {
+	return (a->sType == sVAR || a->sType == sPARAM) && a->sType == b->sType && a->slot == b->slot;
+}
+
+Reduction *planReduction(Statement *stmt, NodeId loop) {
+	ParseNode *node = NODE(stmt, loop), *counter, *body, *target, *sum, *item;
+	Reduction *plan;
+	NodeId expression, *order;
+	Step *step;
+	int *operands, count, depth = 0, ok = 1, i;
+
+	counter = NODE(stmt, node->children[0]);
+	body = NODE(stmt, node->children[3]);
+
+	if (body->sType != sASSIGN)
+		return NULL;
+
+	target = NODE(stmt, body->children[0]);
+	sum = NODE(stmt, body->children[1]);
+
+	if (sum->sType != sARITH || (sum->op.arithop != aPLUS && sum->op.arithop != aSUB) || sameVariable(target, counter))
+		return NULL;
+
+	// total - expression can't be turned around, total + expression can
+	if (sameVariable(NODE(stmt, sum->children[0]), target))
+		expression = sum->children[1];
+	else if (sum->op.arithop == aPLUS && sameVariable(NODE(stmt, sum->children[1]), target))
+		expression = sum->children[0];
+	else
+		return NULL;
+
+	plan = (Reduction *)calloc(1, sizeof(Reduction));
+	plan->counter = counter->slot;
+	plan->counterParam = counter->sType == sPARAM;
+	plan->total = target->slot;
+	plan->totalParam = target->sType == sPARAM;
+	plan->op = sum->op.arithop;
+	plan->totalFirst = expression == sum->children[1];
+
+	count = postorder(stmt, expression, &order);
+	plan->steps = (Step *)calloc(count, sizeof(Step));
+	plan->stepCount = count;
+
+	// each operation takes the last two steps still waiting for one
+	operands = (int *)malloc(count * sizeof(int));
+
+	for (i = 0; i < count && ok; i++) {
+		item = NODE(stmt, order[i]);
+		step = &plan->steps[i];
+
+		switch(item->sType) {
+		case sINT:
+		case sREAL:
+			step->kind = rNUMBER;
+			step->number.type = item->vType;
+			step->number.value = item->value;
+			break;
+		case sVAR:
+		case sPARAM:
+			if (sameVariable(item, target)) {
+				ok = 0;
+			} else if (sameVariable(item, counter)) {
+				step->kind = rCOUNTER;
+			} else {
+				step->kind = item->sType == sVAR ? rVARIABLE : rPARAMETER;
+				step->slot = item->slot;
+			}
+			break;
+		case sARITH:
+			step->kind = rOPERATION;
+			step->op = item->op.arithop;
+			step->right = operands[--depth];
+			step->left = operands[--depth];
+			break;
+		default:
+			ok = 0;
+			break;
+		}
+
+		operands[depth++] = i;
+	}
+
+	free(operands);
+	free(order);
+
+	if (!ok) {
+		freeReduction(plan);
+		return NULL;
+	}
+
+	return plan;
+}
+
+// a variable's value, if it has one and it's a number
+static int number(State *state, int slot, int param, Element *value) {
+	if (param)
+		*value = state->frame[slot];
+	else if (state->slots[slot].defined)
+		*value = state->slots[slot].value;
+	else
+		return 0;
+
+	return value->type == tINT || value->type == tREAL;
+}
+
+static void store(State *state, int slot, int param, Element value) {
+	if (param) {
+		state->frame[slot] = value;
+		return;
+	}
+
+	state->slots[slot].value = value;
+	state->slots[slot].defined = 1;
+}
+
+// Type every step and work out the ones that don't involve the counter, the way the body
+// would. Returns 0 if a variable isn't a number or one of those doesn't come out as one.
+static int prepare(Reduction *plan, State *state) {
+	Step *step, *left, *right;
+	int i;
+
+	for (i = 0; i < plan->stepCount; i++) {
+		step = &plan->steps[i];
+		step->varies = step->read = step->readAsReal = 0;
+
+		switch(step->kind) {
+		case rCOUNTER:
+			step->varies = 1;
+			step->type = tINT;
+			continue;
+		case rNUMBER:
+			step->value = step->number;
+			break;
+		case rVARIABLE:
+		case rPARAMETER:
+			if (!number(state, step->slot, step->kind == rPARAMETER, &step->value))
+				return 0;
+			break;
+		case rOPERATION:
+			left = &plan->steps[step->left];
+			right = &plan->steps[step->right];
+
+			if (left->varies || right->varies) {
+				step->varies = 1;
+				step->type = left->type == tREAL || right->type == tREAL ? tREAL : tINT;
+
+				left->read = right->read = 1;
+				left->readAsReal = right->readAsReal = step->type == tREAL;
+				continue;
+			}
+
+			if (step->op == aDIV && realOf(right->value) == 0)
+				return 0;
+
+			// one that overflowed is a big integer
+			step->value = arithmetic(state, step->op, left->value, right->value);
+
+			if (step->value.type != tINT && step->value.type != tREAL)
+				return 0;
+			break;
+		}
+
+		step->type = step->value.type;
+	}
+
+	// the total reads the expression
+	plan->steps[plan->stepCount - 1].read = 1;
+	return 1;
+}
+
+// a step that doesn't vary has the same value all through every chunk
+static void broadcast(Step *step) {
+	int64_t *ints = step->data;
+	double *reals = step->data;
+	int i;
+
+	for (i = 0; i < REDUCTION_CHUNK; i++) {
+		if (step->type == tINT)
+			ints[i] = step->value.value.integer;
+		else
+			reals[i] = step->value.value.real;
+
+		step->reals[i] = realOf(step->value);
+	}
+}
+
+static void corners(Step *step, __int128 a, __int128 b, __int128 c, __int128 d) {
+	step->low = a < b ? a : b;
+	step->low = c < step->low ? c : step->low;
+	step->low = d < step->low ? d : step->low;
+	step->high = a > b ? a : b;
+	step->high = c > step->high ? c : step->high;
+	step->high = d > step->high ? d : step->high;
+}
+
+// Work out how far each integer step can range while the counter goes from first to last.
+// Returns 0 if one could overflow. (An operation on a real is real, so integer steps only
+// ever read integer steps.)
+static int bound(Reduction *plan, int64_t first, int64_t last) {
+	Step *step, *l, *r;
+	__int128 most;
+	int i;
+
+	for (i = 0; i < plan->stepCount; i++) {
+		step = &plan->steps[i];
+
+		if (step->type != tINT)
+			continue;
+
+		if (!step->varies) {
+			step->low = step->high = step->value.value.integer;
+			continue;
+		}
+
+		if (step->kind == rCOUNTER) {
+			step->low = first;
+			step->high = last;
+			continue;
+		}
+
+		l = &plan->steps[step->left];
+		r = &plan->steps[step->right];
+
+		switch(step->op) {
+		case aPLUS:
+			step->low = l->low + r->low;
+			step->high = l->high + r->high;
+			break;
+		case aSUB:
+			step->low = l->low - r->high;
+			step->high = l->high - r->low;
+			break;
+		case aMULT:
+			corners(step, l->low * r->low, l->low * r->high, l->high * r->low, l->high * r->high);
+			break;
+		case aDIV:
+			// a divisor that could be zero is checked once the chunk's divisors are there,
+			// and then the quotient is no bigger than the dividend
+			if (r->low <= 0 && r->high >= 0) {
+				most = -l->low > l->high ? -l->low : l->high;
+				step->low = -most;
+				step->high = most;
+			} else {
+				corners(step, l->low / r->low, l->low / r->high, l->high / r->low, l->high / r->high);
+			}
+			break;
+		}
+
+		if (step->low < INT64_MIN || step->high > INT64_MAX)
+			return 0;
+	}
+
+	return 1;
+}
+
+// a step's values as type
+static void *operand(Step *step, ValueType type) {
+	return type == tREAL && step->type == tINT ? step->reals : step->data;
+}
+
+// Fill in a chunk of n values of the steps that vary, starting from counter value first.
+// Returns 0 if there's a zero divisor among them.
+static int compute(Reduction *plan, int64_t first, int n) {
+	Step *step;
+	ElemType type;
+	void *a, *b;
+	int64_t *ints;
+	int i, j;
+
+	for (i = 0; i < plan->stepCount; i++) {
+		step = &plan->steps[i];
+		ints = step->data;
+
+		if (!step->varies)
+			continue;
+
+		if (step->kind == rCOUNTER) {
+			for (j = 0; j < n; j++)
+				ints[j] = first + j;
+		} else {
+			type = step->type == tREAL ? eREAL : eINT64;
+			a = operand(&plan->steps[step->left], step->type);
+			b = operand(&plan->steps[step->right], step->type);
+
+			if (step->op == aDIV && hasZero(b, type, n))
+				return 0;
+
+			arrayKernel(type, step->op, step->data, a, b, n);
+		}
+
+		if (step->type == tINT && step->readAsReal) {
+			for (j = 0; j < n; j++)
+				step->reals[j] = (double)ints[j];
+		}
+	}
+
+	return 1;
+}
+
+// Add a chunk of n of the expression's values to the total. Returns 0 if an integer total could
+// overflow.
+static int accumulate(Reduction *plan, Element *total, int n) {
+	Step *root = &plan->steps[plan->stepCount - 1];
+	int64_t *ints = root->data, sum;
+	double *reals = root->data, value;
+	__int128 low, high;
+	int j;
+
+	if (total->type == tINT && root->type == tINT) {
+		if (plan->op == aPLUS) {
+			low = total->value.integer + n * root->low;
+			high = total->value.integer + n * root->high;
+		} else {
+			low = total->value.integer - n * root->high;
+			high = total->value.integer - n * root->low;
+		}
+
+		if (low < INT64_MIN || high > INT64_MAX)
+			return 0;
+
+		// the sum can wrap along the way, the total it ends up at can't
+		sum = arraySum(ints, n);
+		total->value.integer = (int64_t)(plan->op == aPLUS ? (uint64_t)total->value.integer + (uint64_t)sum
+			: (uint64_t)total->value.integer - (uint64_t)sum);
+		return 1;
+	}
+
+	// reals are added one at a time, in order, to round exactly the way the body would
+	value = realOf(*total);
+
+	if (root->type == tINT)
+		reals = root->reals;
+
+	if (plan->op == aSUB) {
+		for (j = 0; j < n; j++)
+			value = value - reals[j];
+	} else if (plan->totalFirst) {
+		for (j = 0; j < n; j++)
+			value = value + reals[j];
+	} else {
+		for (j = 0; j < n; j++)
+			value = reals[j] + value;
+	}
+
+	total->type = tREAL;
+	total->value.real = value;
+	return 1;
+}
+
+int runReduction(Reduction *plan, State *state, int64_t *current, int64_t to, Element *value) {
+	Element total;
+	Step *step;
+	double *buffers;
+	uint64_t after;
+	int64_t last;
+	int n, ran = 0, done = 0, i;
+
+	if (!number(state, plan->total, plan->totalParam, &total) || !prepare(plan, state))
+		return 0;
+
+	// the root's values are always read as reals if the total is a real
+	if (total.type == tREAL)
+		plan->steps[plan->stepCount - 1].readAsReal = 1;
+
+	buffers = (double *)malloc(plan->stepCount * 2 * REDUCTION_CHUNK * sizeof(double));
+
+	for (i = 0; i < plan->stepCount; i++) {
+		step = &plan->steps[i];
+		step->data = buffers + 2 * i * REDUCTION_CHUNK;
+		step->reals = buffers + (2 * i + 1) * REDUCTION_CHUNK;
+
+		if (step->read && !step->varies)
+			broadcast(step);
+	}
+
+	while (1) {
+		// iterations after this one, which is as many as there can be
+		after = (uint64_t)to - (uint64_t)*current;
+		n = after < REDUCTION_CHUNK ? (int)after + 1 : REDUCTION_CHUNK;
+		last = (int64_t)((uint64_t)*current + (n - 1));
+
+		if (!bound(plan, *current, last) || !compute(plan, *current, n) || !accumulate(plan, &total, n))
+			break;
+
+		ran = 1;
+		STAT_ADD(reducedIterations, n);
+
+		if (last == to) {
+			done = 1;
+			break;
+		}
+
+		*current = last + 1;
+	}
+
+	if (ran) {
+		// the counter ends up where the body would have left it
+		store(state, plan->counter, plan->counterParam, (Element){ tINT, { .integer = done ? to : *current - 1 } });
+		store(state, plan->total, plan->totalParam, total);
+		*value = total;
+	}
+
+	free(buffers);
+	return done;
+}
+
+void freeReduction(Reduction *plan) {
+	if (plan == NULL)
+		return;
+
+	free(plan->steps);
+	free(plan);
+}
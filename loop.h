@@ -0,0 +1,41 @@
+#ifndef __LOOP_H__
+#define __LOOP_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+#include <stdint.h>
+
+// `for i in a..b do body end` runs body with i set to each integer from a to b in turn.
+//
+// A loop whose body only adds to one variable, `total = total + expression` (or takes away
+// from it), where the expression is arithmetic on i, numbers and variables the body doesn't
+// change, is a reduction. One of those runs a chunk of the range at a time through the array
+// kernels, with the parts of the expression that don't involve i worked out once up front.
+// Whenever it can't be sure a chunk comes out exactly as running the body would (an integer
+// that could overflow, a zero divisor, a variable that isn't a number) the body runs instead.
+
+// loops this long or longer are worth running as reductions, this many iterations at a time
+#define REDUCTION_MIN 64
+#define REDUCTION_CHUNK 1024
+
+typedef struct tagReduction Reduction;
+
+// Check a loop's bounds: 1 if they're integers and there's at least one iteration. Bounds that
+// aren't integers are an error, a nil one quietly gives a loop that doesn't run.
+int loopBounds(State *state, Element from, Element to);
+
+// Whether a loop from from to to is long enough to run as a reduction (and not in reactive mode)
+int worthReducing(State *state, int64_t from, int64_t to);
+
+// The plan for running an sFOR node as a reduction, NULL if its body isn't one
+Reduction *planReduction(Statement *stmt, NodeId loop);
+
+// Run iterations *current to to a chunk at a time for as long as that's safe. Leaves *current
+// at the first iteration still to run and, if any ran, *value at the body's value for the last
+// one. Returns 1 if they all did.
+int runReduction(Reduction *plan, State *state, int64_t *current, int64_t to, Element *value);
+
+void freeReduction(Reduction *plan);
+
+#endif
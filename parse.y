@@ -3,10 +3,15 @@
 #include "parse.h"
 #include "lex.h"
 
-#include <stdio.h>
-
-int yyerror(ParseNode **expression, yyscan_t scanner, const char *msg) {
-	printf("Error: %s\n", msg);
+// the parser's stack is on the heap, and generated code can nest far deeper than the 10000
+// levels bison allows by default
+#define YYMAXDEPTH 10000000
+
+// bison's messages are string constants, so keeping the pointer is fine
+int yyerror(Statement *statement, yyscan_t scanner, const char *msg) {
+	statement->syntaxError = msg;
+	statement->errorLine = yyget_lineno(scanner);
+	return 0;
 }
 %}
 
@@ -15,6 +20,8 @@ int yyerror(ParseNode **expression, yyscan_t scanner, const char *msg) {
 	#define YY_TYPEDEF_YY_SCANNER_T
 	typedef void* yyscan_t;
 	#endif
+
+	#include <stdint.h>
 }
 
 %output  "parse.c"
@@ -22,18 +29,24 @@ int yyerror(ParseNode **expression, yyscan_t scanner, const char *msg) {
 
 %define api.pure
 %lex-param   { yyscan_t scanner }
-%parse-param { ParseNode **statement }
+%parse-param { Statement *statement }
 %parse-param { yyscan_t scanner }
 
 %union {
-	int value;
-	char *name;
-	ParseNode *statement;
+	int64_t value;
+	double real;
+	int name;
+	NodeId statement;
 }
 
-%left '<' '>' '==' LESS_THAN GREATER_THAN EQUAL_TO
+%left '<' '>' LESS_THAN GREATER_THAN EQUAL_TO
 %left '+' '-' '*' '/' TOKEN_PLUS TOKEN_SUB TOKEN_MULT TOKEN_DIV
 
+// a name followed by ( is a call, rather than a variable ending one statement and a
+// parenthesized one starting the next
+%precedence VARIABLE
+%precedence LPAREN
+
 %token IF_START
 %token THEN
 %token ELSE
@@ -44,46 +57,124 @@ int yyerror(ParseNode **expression, yyscan_t scanner, const char *msg) {
 
 %token ASSIGN_INTERMEDIATE
 
+%token DEF
+
+%token FOR
+%token IN
+%token DO
+%token RANGE
+%token RPAREN
+
+%token LBRACKET
+%token RBRACKET
+%token COMMA
+
 %token <name> VAR
 %token <value> VAL
+%token <name> BIGVAL
+%token <real> REAL
 
 %type <statement> stmt
 %type <statement> exp
 %type <statement> bool
 %type <statement> arith
+%type <statement> array
+%type <statement> elements
+%type <statement> number
+%type <statement> parameters
+%type <statement> names
+%type <statement> parameter
+%type <statement> arguments
+%type <statement> args
+%type <statement> arg
 
 %%
 input
-	: stmt { *statement = $1; }
+	: %empty
+	| input stmt { addRoot(statement, $2); }
 	;
 
 stmt
-	: VAR ASSIGN_INTERMEDIATE stmt { $$ = createAssign(createVariable($1), $3); free($1);}
-	| IF_START bool THEN stmt IF_END { $$ = createIf($2, $4); }
-	| IF_START bool THEN stmt ELSE stmt IF_END { $$ = createIfElse($2, $4, $6); }
+	: VAR ASSIGN_INTERMEDIATE stmt { $$ = createAssign(statement, createVariable(statement, $1), $3); }
+	| IF_START bool THEN stmt IF_END { $$ = createIf(statement, $2, $4); }
+	| IF_START bool THEN stmt ELSE stmt IF_END { $$ = createIfElse(statement, $2, $4, $6); }
+	| DEF VAR LPAREN parameters RPAREN ASSIGN_INTERMEDIATE stmt { $$ = createDef(statement, $2, $4, $7); }
+	| FOR VAR IN exp RANGE exp DO stmt IF_END { $$ = createFor(statement, createVariable(statement, $2), $4, $6, $8); }
 	| exp
 	| bool
 	;
 
 bool
-	: exp LESS_THAN exp { $$ = createBool(bLESSTHAN, $1, $3); }
-	| exp GREATER_THAN exp { $$ = createBool(bGREATERTHAN, $1, $3); }
-	| exp EQUAL_TO exp { $$ = createBool(bEQUALTO, $1, $3); }
-	| TOKEN_TRUE { $$ = createBoolTerminal(1); }
-	| TOKEN_FALSE { $$ = createBoolTerminal(0); }
+	: exp LESS_THAN exp { $$ = createBool(statement, bLESSTHAN, $1, $3); }
+	| exp GREATER_THAN exp { $$ = createBool(statement, bGREATERTHAN, $1, $3); }
+	| exp EQUAL_TO exp { $$ = createBool(statement, bEQUALTO, $1, $3); }
+	| TOKEN_TRUE { $$ = createBoolTerminal(statement, 1); }
+	| TOKEN_FALSE { $$ = createBoolTerminal(statement, 0); }
+	| LPAREN bool RPAREN { $$ = $2; }
 	;
 
 exp
 	: arith
-	| VAL { $$ = createInt($1); }
-	| VAR { $$ = createVariable($1); free($1); }
+	| VAL { $$ = createInt(statement, $1); }
+	| BIGVAL { $$ = createBig(statement, $1); }
+	| REAL { $$ = createReal(statement, $1); }
+	| VAR %prec VARIABLE { $$ = createVariable(statement, $1); }
+	| VAR LPAREN arguments RPAREN { $$ = createCall(statement, $1, $3); }
+	| LPAREN exp RPAREN { $$ = $2; }
+	| array
+	;
+
+parameters
+	: %empty { $$ = createNil(statement); }
+	| names
+	;
+
+names
+	: parameter { $$ = createList(statement, $1, createNil(statement)); }
+	| parameter COMMA names { $$ = createList(statement, $1, $3); }
+	;
+
+parameter
+	: VAR { $$ = createVariable(statement, $1); }
+	;
+
+arguments
+	: %empty { $$ = createNil(statement); }
+	| args
+	;
+
+args
+	: arg { $$ = createList(statement, $1, createNil(statement)); }
+	| arg COMMA args { $$ = createList(statement, $1, $3); }
+	;
+
+arg
+	: exp
+	| bool
+	;
+
+array
+	: LBRACKET RBRACKET { $$ = createArray(statement); }
+	| LBRACKET elements RBRACKET { $$ = $2; }
+	;
+
+elements
+	: number { $$ = appendElement(statement, createArray(statement), $1); }
+	| elements COMMA number { $$ = appendElement(statement, $1, $3); }
+	;
+
+number
+	: VAL { $$ = createInt(statement, $1); }
+	| REAL { $$ = createReal(statement, $1); }
+	| TOKEN_SUB VAL { $$ = createInt(statement, -$2); }
+	| TOKEN_SUB REAL { $$ = createReal(statement, -$2); }
 	;
 
 arith
-	: exp TOKEN_MULT exp { $$ = createArith(aMULT, $1, $3); }
-	| exp TOKEN_PLUS exp { $$ = createArith(aPLUS, $1, $3); }
-	| exp TOKEN_SUB exp { $$ = createArith(aSUB, $1, $3); }
-	| exp TOKEN_DIV exp { $$ = createArith(aDIV, $1, $3); }
+	: exp TOKEN_MULT exp { $$ = createArith(statement, aMULT, $1, $3); }
+	| exp TOKEN_PLUS exp { $$ = createArith(statement, aPLUS, $1, $3); }
+	| exp TOKEN_SUB exp { $$ = createArith(statement, aSUB, $1, $3); }
+	| exp TOKEN_DIV exp { $$ = createArith(statement, aDIV, $1, $3); }
 	;
 
 %%
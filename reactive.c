@@ -0,0 +1,287 @@
+#include "reactive.h"
+#include "eval.h"
+#include "vm.h"
+#include "stats.h"
+
+#include <stdlib.h>
+
+// a list of slots that grows as needed
+typedef struct tagSlotList {
+	int *items;
+	int count;
+	int capacity;
+} SlotList;
+
+static void append(SlotList *list, int slot) {
+	if (list->count == list->capacity) {
+		list->capacity = list->capacity ? list->capacity * 2 : 8;
+		list->items = (int *)realloc(list->items, list->capacity * sizeof(int));
+	}
+
+	list->items[list->count++] = slot;
+}
+
+static Cell *cellOf(State *state, int slot) {
+	if (state->slots[slot].cell == NULL)
+		state->slots[slot].cell = (Cell *)calloc(1, sizeof(Cell));
+
+	return state->slots[slot].cell;
+}
+
+static void addDependent(Cell *cell, int slot) {
+	SlotList list = { cell->dependents, cell->dependentCount, cell->dependentCapacity };
+
+	append(&list, slot);
+
+	cell->dependents = list.items;
+	cell->dependentCount = list.count;
+	cell->dependentCapacity = list.capacity;
+}
+
+static void removeDependent(Cell *cell, int slot) {
+	int i;
+
+	// order doesn't matter, fill the hole with the last one
+	for (i = 0; i < cell->dependentCount; i++) {
+		if (cell->dependents[i] == slot) {
+			cell->dependents[i] = cell->dependents[--cell->dependentCount];
+			return;
+		}
+	}
+}
+
+// the variables an expression reads, each once; 0 if it assigns to anything (a loop assigns to
+// its counter) or calls a function (whose body could read anything)
+static int collectInputs(Statement *stmt, NodeId id, SlotList *inputs) {
+	ParseNode *node;
+	NodeId *order;
+	int count = postorder(stmt, id, &order), i, j, ok = 1;
+
+	for (i = 0; i < count && ok; i++) {
+		node = NODE(stmt, order[i]);
+
+		if (node->sType == sASSIGN || node->sType == sFOR || node->sType == sCALL)
+			ok = 0;
+
+		if (node->sType != sVAR)
+			continue;
+
+		for (j = 0; j < inputs->count && inputs->items[j] != node->slot; j++)
+			;
+
+		if (j == inputs->count)
+			append(inputs, node->slot);
+	}
+
+	free(order);
+	return ok;
+}
+
+// whether target reading inputs would go round in a circle: it would if one of them is
+// target itself or something already defined in terms of it
+static int circular(State *state, int target, SlotList *inputs) {
+	SlotList walk = { 0 };
+	Cell *cell, *dependent;
+	int head, i, slot, found = 0;
+
+	append(&walk, target);
+	if (state->slots[target].cell != NULL)
+		state->slots[target].cell->seen = 1;
+
+	for (head = 0; head < walk.count && !found; head++) {
+		slot = walk.items[head];
+
+		for (i = 0; i < inputs->count; i++)
+			found |= inputs->items[i] == slot;
+
+		if ((cell = state->slots[slot].cell) == NULL)
+			continue;
+
+		for (i = 0; i < cell->dependentCount; i++) {
+			dependent = state->slots[cell->dependents[i]].cell;
+
+			if (!dependent->seen) {
+				dependent->seen = 1;
+				append(&walk, cell->dependents[i]);
+			}
+		}
+	}
+
+	for (i = 0; i < walk.count; i++) {
+		if ((cell = state->slots[walk.items[i]].cell) != NULL)
+			cell->seen = 0;
+	}
+
+	free(walk.items);
+	return found;
+}
+
+// mark everything downstream of slot out of date; whatever's dirty already has dirty
+// dependents, so the walk stops there
+static void invalidate(State *state, int slot) {
+	SlotList walk = { 0 };
+	Cell *cell, *dependent;
+	int head, i;
+
+	append(&walk, slot);
+
+	for (head = 0; head < walk.count; head++) {
+		if ((cell = state->slots[walk.items[head]].cell) == NULL)
+			continue;
+
+		for (i = 0; i < cell->dependentCount; i++) {
+			dependent = state->slots[cell->dependents[i]].cell;
+
+			if (!dependent->dirty) {
+				dependent->dirty = 1;
+				append(&walk, cell->dependents[i]);
+				STAT_INC(invalidations);
+			}
+		}
+	}
+
+	free(walk.items);
+}
+
+static void dropFormula(State *state, int slot) {
+	Cell *cell = state->slots[slot].cell;
+	int i;
+
+	if (cell->formula == NULL)
+		return;
+
+	for (i = 0; i < cell->inputCount; i++)
+		removeDependent(state->slots[cell->inputs[i]].cell, slot);
+
+	// the chunk points at the statement's literals
+	if (cell->chunk != NULL)
+		freeChunk(cell->chunk);
+	deleteStatement(cell->formula);
+	free(cell->inputs);
+
+	cell->formula = NULL;
+	cell->chunk = NULL;
+	cell->inputs = NULL;
+	cell->inputCount = 0;
+	cell->dirty = 0;
+}
+
+void defineFormula(State *state, Statement *stmt, NodeId root) {
+	ParseNode *node = NODE(stmt, root);
+	int target = NODE(stmt, node->children[0])->slot;
+	SlotList inputs = { 0 };
+	Cell *cell;
+	int i;
+
+	// a constant is just a value, something that reads itself is just an assignment
+	if (!collectInputs(stmt, node->children[1], &inputs) || inputs.count == 0 || circular(state, target, &inputs)) {
+		free(inputs.items);
+		return;
+	}
+
+	// running the assignment has dropped whatever the definition was before. The statement
+	// could be a cache entry that gets recycled, so the definition is a copy.
+	cell = cellOf(state, target);
+	cell->formula = newStatement();
+	addRoot(cell->formula, copySubtree(cell->formula, stmt, node->children[1]));
+
+	cell->inputs = inputs.items;
+	cell->inputCount = inputs.count;
+
+	for (i = 0; i < inputs.count; i++)
+		addDependent(cellOf(state, inputs.items[i]), target);
+}
+
+void slotAssigned(State *state, int slot) {
+	Cell *cell = state->slots[slot].cell;
+
+	if (cell == NULL)
+		return;
+
+	dropFormula(state, slot);
+
+	if (cell->dependentCount > 0)
+		invalidate(state, slot);
+}
+
+// run a dirty slot's formula, whose inputs are all up to date
+static void recompute(State *state, int slot) {
+	Cell *cell = state->slots[slot].cell;
+	Statement *formula = cell->formula;
+	Element value = NIL;
+
+	if (state->treeWalk) {
+		value = evaluate(formula, formula->roots[0], state);
+	} else {
+		if (cell->chunk == NULL)
+			cell->chunk = compile(formula, formula->roots[0], state);
+
+		if (cell->chunk != NULL)
+			value = execute(cell->chunk, state);
+	}
+
+	// formulas don't assign, so nothing can have added slots or changed cells meanwhile
+	state->slots[slot].value = value;
+	cell->dirty = 0;
+	cell->seen = 0;
+
+	STAT_INC(recomputes);
+}
+
+void refreshSlot(State *state, int slot) {
+	SlotList stack = { 0 }, next = { 0 }, order = { 0 };
+	Cell *cell = state->slots[slot].cell, *input;
+	int top, i;
+
+	if (cell == NULL || !cell->dirty)
+		return;
+
+	// depth first through the dirty inputs, with a stack of our own since chains of
+	// definitions can be as long as a script. A slot goes on the order once everything it
+	// reads is on it.
+	cell->seen = 1;
+	append(&stack, slot);
+	append(&next, 0);
+
+	while (stack.count > 0) {
+		top = stack.items[stack.count - 1];
+		cell = state->slots[top].cell;
+		i = next.items[next.count - 1];
+
+		if (i < cell->inputCount) {
+			next.items[next.count - 1]++;
+			input = state->slots[cell->inputs[i]].cell;
+
+			if (input != NULL && input->dirty && !input->seen) {
+				input->seen = 1;
+				append(&stack, cell->inputs[i]);
+				append(&next, 0);
+			}
+		} else {
+			stack.count--;
+			next.count--;
+			append(&order, top);
+		}
+	}
+
+	for (i = 0; i < order.count; i++)
+		recompute(state, order.items[i]);
+
+	free(stack.items);
+	free(next.items);
+	free(order.items);
+}
+
+void freeCell(Cell *cell) {
+	if (cell == NULL)
+		return;
+
+	if (cell->chunk != NULL)
+		freeChunk(cell->chunk);
+	if (cell->formula != NULL)
+		deleteStatement(cell->formula);
+
+	free(cell->inputs);
+	free(cell->dependents);
+	free(cell);
+}
@@ -0,0 +1,55 @@
+#ifndef __REACTIVE_H__
+#define __REACTIVE_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+// Reactive mode (--reactive) makes terp work like a spreadsheet. A top-level statement
+// `name = expression` that reads other variables becomes name's definition: giving any of
+// those variables a new value marks name (and whatever is defined in terms of name, and so
+// on) out of date, and the next time name is read it's recomputed, after anything out of date
+// that it reads. Assigning to name directly, or defining it again, replaces its definition.
+//
+// Expressions that assign to something, or that would make a variable depend on itself (like
+// `i = i + 1`), are plain assignments.
+struct tagChunk;
+
+// What a slot needs in reactive mode, made the first time it's defined or read by a definition
+typedef struct tagCell {
+	// the definition, the expression on its own as the only root of a statement (NULL if the
+	// variable was just given a value), compiled the first time it's recomputed
+	Statement *formula;
+	struct tagChunk *chunk;
+
+	// the slots the formula reads
+	int *inputs;
+	int inputCount;
+
+	// the slots whose formulas read this one
+	int *dependents;
+	int dependentCount;
+	int dependentCapacity;
+
+	// the value is older than one of the formula's inputs; everything that depends on a
+	// dirty slot is dirty too
+	int dirty;
+
+	// already on the list being worked through by one of the graph walks
+	int seen;
+} Cell;
+
+// Make the top-level assignment at root (which has just run) its variable's definition, if
+// it can be one
+void defineFormula(State *state, Statement *stmt, NodeId root);
+
+// A variable was assigned to: it loses its definition and everything that depends on it
+// goes out of date
+void slotAssigned(State *state, int slot);
+
+// Recompute a variable if it's out of date, along with whatever out of date variables it
+// reads, in dependency order
+void refreshSlot(State *state, int slot);
+
+void freeCell(Cell *cell);
+
+#endif
@@ -0,0 +1,922 @@
+#include "scan.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// the same tokens lex.l returns
+typedef enum tagTokenType {
+	kEND_OF_INPUT,
+	kIF,
+	kTHEN,
+	kELSE,
+	kEND,
+	kASSIGN,
+	kMULT,
+	kPLUS,
+	kSUB,
+	kDIV,
+	kTRUE,
+	kFALSE,
+	kLBRACKET,
+	kRBRACKET,
+	kCOMMA,
+	kLPAREN,
+	kRPAREN,
+	kLESS,
+	kGREATER,
+	kEQUAL,
+	kVAL,
+	kBIG,
+	kREAL,
+	kVAR,
+	kDEF,
+	kFOR,
+	kIN,
+	kDO,
+	kRANGE
+} TokenType;
+
+// A token is a slice of the text, nothing is copied until a node needs it. Integers are
+// worked out while scanning, since whether one fits in 64 bits decides what kind it is.
+typedef struct tagToken {
+	TokenType type;
+	size_t start;
+	int length;
+
+	// the line it's on, for syntax errors
+	int line;
+
+	// a VAL's value
+	int64_t value;
+} Token;
+
+typedef struct tagScanner {
+	const char *text;
+	size_t length;
+	size_t at;
+	int line;
+} Scanner;
+
+// Something still waiting for what's inside it. A statement: an assignment or definition for
+// its value, an if for its condition or its then or else branch, a loop for either bound or
+// its body. An expression: its next
+// operand, a parenthesis for what's in it to close, a call for its arguments (the ones done so
+// far are items above it).
+typedef enum tagFrameType {
+	fASSIGN,
+	fDEF,
+	fCOND,
+	fTHEN,
+	fELSE,
+	fFROM,
+	fTO,
+	fFOR,
+	fEXPR,
+	fGROUP,
+	fCALL,
+	fITEM
+} FrameType;
+
+typedef struct tagFrame {
+	FrameType type;
+
+	// what's assigned, defined, called or counted
+	int name;
+
+	// an if's condition and then branch, a definition's parameters, an item, a loop's bounds
+	NodeId cond;
+	NodeId then;
+
+	// An expression: whether it can be a bool, the arithmetic so far and the operator waiting
+	// for its right hand side, and what's on the left of its comparison (NO_NODE if none yet)
+	int allowBool;
+	NodeId left;
+	TokenType op;
+	NodeId compared;
+	TokenType comparison;
+} Frame;
+
+// what the parser does next: start a statement, read an operand or what follows one, finish
+// the innermost expression with what it has (and whatever that completes), or stop
+typedef enum tagMode {
+	mSTATEMENT,
+	mOPERAND,
+	mOPERATOR,
+	mFINISH,
+	mDONE,
+	mFAIL
+} Mode;
+
+// statements and expressions nested up to this deep keep their frames in the parser
+#define SMALL_FRAMES 64
+
+typedef struct tagParser {
+	Statement *stmt;
+	Scanner scanner;
+
+	// the token being looked at and the one after it (an identifier followed by = starts an
+	// assignment)
+	Token token;
+	Token next;
+
+	// statements and expressions are nested with a stack of our own, as deep as a script likes
+	Frame *frames;
+	int depth;
+	int capacity;
+	Frame smallFrames[SMALL_FRAMES];
+} Parser;
+
+// binary operator precedence, 0 for anything else. All arithmetic is one left associative
+// level, the way parse.y declares it.
+#define COMPARISON 1
+#define ARITHMETIC 2
+
+/*
+ * Scanning
+ */
+
+static int isSpace(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int isDigit(char c) {
+	return (unsigned)(c - '0') < 10;
+}
+
+// ASCII letters only, whatever the locale
+static int isLetter(char c) {
+	return (unsigned)((c | 0x20) - 'a') < 26;
+}
+
+#ifdef __SSE2__
+// lanes whose unsigned byte is in [low, low + n)
+static __m128i inRange(__m128i bytes, char low, int n) {
+	__m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8(low));
+
+	// there's no unsigned byte compare, so flip the sign bits and compare signed
+	offset = _mm_xor_si128(offset, _mm_set1_epi8((char)0x80));
+	return _mm_cmplt_epi8(offset, _mm_set1_epi8((char)(n ^ 0x80)));
+}
+#endif
+
+// move past whitespace, counting the lines it ends
+static void skipSpace(Scanner *scanner) {
+	const char *text = scanner->text;
+	size_t at = scanner->at, end = scanner->length;
+	int line = scanner->line;
+
+	// most tokens are followed by one space or none
+	if (at == end || !isSpace(text[at]))
+		return;
+
+#ifdef __SSE2__
+	while (at + 16 <= end) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *)(text + at));
+		__m128i newlines = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'));
+		__m128i spaces = _mm_or_si128(_mm_or_si128(newlines, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '))),
+			_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+		unsigned space = _mm_movemask_epi8(spaces), lines = _mm_movemask_epi8(newlines);
+		int n;
+
+		if (space != 0xFFFF) {
+			n = __builtin_ctz(~space);
+			scanner->line = line + __builtin_popcount(lines & ((1u << n) - 1));
+			scanner->at = at + n;
+			return;
+		}
+
+		line += __builtin_popcount(lines);
+		at += 16;
+	}
+#endif
+
+	for (; at < end && isSpace(text[at]); at++)
+		line += text[at] == '\n';
+
+	scanner->line = line;
+	scanner->at = at;
+}
+
+// where the identifier continuing at at ends
+static size_t identifierEnd(const char *text, size_t at, size_t end) {
+#ifdef __SSE2__
+	while (at + 16 <= end) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *)(text + at));
+		__m128i letters = inRange(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 26);
+		unsigned name = _mm_movemask_epi8(_mm_or_si128(letters, inRange(bytes, '0', 10)));
+
+		if (name != 0xFFFF)
+			return at + __builtin_ctz(~name);
+
+		at += 16;
+	}
+#endif
+
+	while (at < end && (isLetter(text[at]) || isDigit(text[at])))
+		at++;
+
+	return at;
+}
+
+static TokenType keyword(const char *name, int length) {
+	switch(length) {
+	case 2:
+		if (memcmp(name, "if", 2) == 0)
+			return kIF;
+		if (memcmp(name, "in", 2) == 0)
+			return kIN;
+		if (memcmp(name, "do", 2) == 0)
+			return kDO;
+		break;
+	case 3:
+		if (memcmp(name, "end", 3) == 0)
+			return kEND;
+		if (memcmp(name, "def", 3) == 0)
+			return kDEF;
+		if (memcmp(name, "for", 3) == 0)
+			return kFOR;
+		break;
+	case 4:
+		if (memcmp(name, "then", 4) == 0)
+			return kTHEN;
+		if (memcmp(name, "else", 4) == 0)
+			return kELSE;
+		if (memcmp(name, "true", 4) == 0)
+			return kTRUE;
+		break;
+	case 5:
+		if (memcmp(name, "false", 5) == 0)
+			return kFALSE;
+		break;
+	}
+
+	return kVAR;
+}
+
+// digits, or digits.digits for a real
+static void scanNumber(Scanner *scanner, Token *token) {
+	const char *text = scanner->text;
+	size_t at = scanner->at, end = scanner->length;
+	int64_t value = 0;
+	int digit, overflow = 0;
+
+	for (; at < end && isDigit(text[at]); at++) {
+		digit = text[at] - '0';
+
+		if (value > (INT64_MAX - digit) / 10)
+			overflow = 1;
+		else
+			value = value * 10 + digit;
+	}
+
+	if (at + 1 < end && text[at] == '.' && isDigit(text[at + 1])) {
+		for (at++; at < end && isDigit(text[at]); at++)
+			;
+
+		token->type = kREAL;
+	} else {
+		// too big for 64 bits, the parser makes a big integer of the digits
+		token->type = overflow ? kBIG : kVAL;
+		token->value = value;
+	}
+
+	token->length = at - scanner->at;
+	scanner->at = at;
+}
+
+static void scan(Scanner *scanner, Token *token) {
+	const char *text = scanner->text;
+	size_t at;
+
+	while (1) {
+		skipSpace(scanner);
+
+		at = scanner->at;
+		token->start = at;
+		token->line = scanner->line;
+		token->length = 1;
+
+		if (at == scanner->length) {
+			token->type = kEND_OF_INPUT;
+			token->length = 0;
+			return;
+		}
+
+		if (isDigit(text[at])) {
+			scanNumber(scanner, token);
+			return;
+		}
+
+		if (isLetter(text[at])) {
+			scanner->at = identifierEnd(text, at + 1, scanner->length);
+			token->length = scanner->at - at;
+			token->type = keyword(text + at, token->length);
+			return;
+		}
+
+		switch(text[at]) {
+		case '=':
+			if (at + 1 < scanner->length && text[at + 1] == '=') {
+				token->type = kEQUAL;
+				token->length = 2;
+			} else {
+				token->type = kASSIGN;
+			}
+			break;
+		case '*':
+			token->type = kMULT;
+			break;
+		case '+':
+			token->type = kPLUS;
+			break;
+		case '-':
+			token->type = kSUB;
+			break;
+		case '/':
+			token->type = kDIV;
+			break;
+		case '[':
+			token->type = kLBRACKET;
+			break;
+		case ']':
+			token->type = kRBRACKET;
+			break;
+		case ',':
+			token->type = kCOMMA;
+			break;
+		case '(':
+			token->type = kLPAREN;
+			break;
+		case ')':
+			token->type = kRPAREN;
+			break;
+		case '<':
+			token->type = kLESS;
+			break;
+		case '>':
+			token->type = kGREATER;
+			break;
+		case '.':
+			// a lone . is skipped like any other stray character
+			if (at + 1 < scanner->length && text[at + 1] == '.') {
+				token->type = kRANGE;
+				token->length = 2;
+				break;
+			}
+
+			scanner->at++;
+			continue;
+		default:
+			// skip everything else, like lex.l does
+			scanner->at++;
+			continue;
+		}
+
+		scanner->at += token->length;
+		return;
+	}
+}
+
+/*
+ * Parsing
+ */
+
+static void advance(Parser *parser) {
+	parser->token = parser->next;
+	scan(&parser->scanner, &parser->next);
+}
+
+// bison's message, at the token it would have given up on
+static NodeId fail(Parser *parser) {
+	parser->stmt->syntaxError = "syntax error";
+	parser->stmt->errorLine = parser->token.line;
+
+	return NO_NODE;
+}
+
+// the current token's text in the statement's name pool
+static int intern(Parser *parser) {
+	return internName(parser->stmt, parser->scanner.text + parser->token.start, parser->token.length);
+}
+
+static double realValue(Parser *parser) {
+	Token *token = &parser->token;
+	char small[64], *copy = small;
+	double value;
+
+	// strtod() wants a string, and would read an exponent lex.l doesn't
+	if (token->length >= (int)sizeof small)
+		copy = (char *)malloc(token->length + 1);
+
+	memcpy(copy, parser->scanner.text + token->start, token->length);
+	copy[token->length] = '\0';
+	value = strtod(copy, NULL);
+
+	if (copy != small)
+		free(copy);
+
+	return value;
+}
+
+static Frame *push(Parser *parser, FrameType type) {
+	if (parser->depth == parser->capacity) {
+		parser->capacity *= 2;
+
+		if (parser->frames == parser->smallFrames) {
+			parser->frames = (Frame *)malloc(parser->capacity * sizeof(Frame));
+			memcpy(parser->frames, parser->smallFrames, sizeof parser->smallFrames);
+		} else {
+			parser->frames = (Frame *)realloc(parser->frames, parser->capacity * sizeof(Frame));
+		}
+	}
+
+	parser->frames[parser->depth].type = type;
+	return &parser->frames[parser->depth++];
+}
+
+// an array element: an integer or real, possibly negative
+static NodeId number(Parser *parser) {
+	int negative = parser->token.type == kSUB;
+	NodeId id;
+
+	if (negative)
+		advance(parser);
+
+	if (parser->token.type == kVAL)
+		id = createInt(parser->stmt, negative ? -parser->token.value : parser->token.value);
+	else if (parser->token.type == kREAL)
+		id = createReal(parser->stmt, negative ? -realValue(parser) : realValue(parser));
+	else
+		return fail(parser);
+
+	advance(parser);
+	return id;
+}
+
+// [] or [number, ...]
+static NodeId array(Parser *parser) {
+	NodeId id = NO_NODE, element;
+
+	advance(parser);
+
+	if (parser->token.type == kRBRACKET) {
+		advance(parser);
+		return createArray(parser->stmt);
+	}
+
+	while (1) {
+		if ((element = number(parser)) == NO_NODE)
+			return NO_NODE;
+
+		// the first element is made before the array, as in parse.y
+		if (id == NO_NODE)
+			id = createArray(parser->stmt);
+		appendElement(parser->stmt, id, element);
+
+		if (parser->token.type == kRBRACKET) {
+			advance(parser);
+			return id;
+		}
+
+		if (parser->token.type != kCOMMA)
+			return fail(parser);
+		advance(parser);
+	}
+}
+
+static int precedence(TokenType type) {
+	switch(type) {
+	case kLESS:
+	case kGREATER:
+	case kEQUAL:
+		return COMPARISON;
+	case kMULT:
+	case kPLUS:
+	case kSUB:
+	case kDIV:
+		return ARITHMETIC;
+	default:
+		return 0;
+	}
+}
+
+static NodeId combine(Statement *stmt, TokenType op, NodeId left, NodeId right) {
+	switch(op) {
+	case kLESS:
+		return createBool(stmt, bLESSTHAN, left, right);
+	case kGREATER:
+		return createBool(stmt, bGREATERTHAN, left, right);
+	case kEQUAL:
+		return createBool(stmt, bEQUALTO, left, right);
+	case kMULT:
+		return createArith(stmt, aMULT, left, right);
+	case kPLUS:
+		return createArith(stmt, aPLUS, left, right);
+	case kSUB:
+		return createArith(stmt, aSUB, left, right);
+	default:
+		return createArith(stmt, aDIV, left, right);
+	}
+}
+
+static int isBool(Statement *stmt, NodeId id) {
+	return NODE(stmt, id)->sType == sBOOL || NODE(stmt, id)->sType == sBOOLVAL;
+}
+
+static Mode reject(Parser *parser) {
+	fail(parser);
+	return mFAIL;
+}
+
+// an expression with nothing in it yet, which can turn out to be a bool if allowBool
+static void expression(Parser *parser, int allowBool) {
+	Frame *level = push(parser, fEXPR);
+
+	level->allowBool = allowBool;
+	level->left = NO_NODE;
+	level->op = kEND_OF_INPUT;
+	level->compared = NO_NODE;
+}
+
+static int empty(Frame *level) {
+	return level->left == NO_NODE && level->compared == NO_NODE;
+}
+
+// an operand for the innermost expression, on the right of its operator if it has one
+static void take(Parser *parser, NodeId value) {
+	Frame *level = &parser->frames[parser->depth - 1];
+
+	if (level->op != kEND_OF_INPUT)
+		value = combine(parser->stmt, level->op, level->left, value);
+
+	level->left = value;
+	level->op = kEND_OF_INPUT;
+}
+
+// def name(parameter, ...) =, the parameters are made as soon as the header is complete
+static Mode definition(Parser *parser) {
+	Statement *stmt = parser->stmt;
+	NodeId params, param;
+	Frame *frame;
+	int name, count = 0;
+
+	advance(parser);
+
+	if (parser->token.type != kVAR)
+		return reject(parser);
+	name = intern(parser);
+	advance(parser);
+
+	if (parser->token.type != kLPAREN)
+		return reject(parser);
+	advance(parser);
+
+	// each one is an item until they're all there
+	while (parser->token.type != kRPAREN) {
+		if (count > 0) {
+			if (parser->token.type != kCOMMA)
+				return reject(parser);
+			advance(parser);
+		}
+
+		if (parser->token.type != kVAR)
+			return reject(parser);
+
+		param = createVariable(stmt, intern(parser));
+		push(parser, fITEM)->cond = param;
+		count++;
+		advance(parser);
+	}
+
+	// the list is built back to front, as bison reduces it
+	for (params = createNil(stmt); count > 0; count--)
+		params = createList(stmt, parser->frames[--parser->depth].cond, params);
+
+	advance(parser);
+
+	if (parser->token.type != kASSIGN)
+		return reject(parser);
+	advance(parser);
+
+	frame = push(parser, fDEF);
+	frame->name = name;
+	frame->cond = params;
+
+	return mSTATEMENT;
+}
+
+// open up whatever the statement starts with
+static Mode begin(Parser *parser) {
+	switch(parser->token.type) {
+	case kVAR:
+		if (parser->next.type != kASSIGN)
+			break;
+
+		// the name goes in the pool now, before the value's (where the lexer puts it)
+		push(parser, fASSIGN)->name = intern(parser);
+		advance(parser);
+		advance(parser);
+		return mSTATEMENT;
+	case kIF:
+		advance(parser);
+
+		push(parser, fCOND);
+		expression(parser, 1);
+		return mOPERAND;
+	case kDEF:
+		return definition(parser);
+	case kFOR:
+		advance(parser);
+
+		if (parser->token.type != kVAR)
+			return reject(parser);
+
+		push(parser, fFROM)->name = intern(parser);
+		advance(parser);
+
+		if (parser->token.type != kIN)
+			return reject(parser);
+		advance(parser);
+
+		expression(parser, 0);
+		return mOPERAND;
+	default:
+		break;
+	}
+
+	expression(parser, 1);
+	return mOPERAND;
+}
+
+static Mode operand(Parser *parser) {
+	Statement *stmt = parser->stmt;
+	Frame *level = &parser->frames[parser->depth - 1];
+	NodeId id;
+	int name, allowBool;
+
+	switch(parser->token.type) {
+	case kVAL:
+		id = createInt(stmt, parser->token.value);
+		break;
+	case kBIG:
+		id = createBig(stmt, intern(parser));
+		break;
+	case kREAL:
+		id = createReal(stmt, realValue(parser));
+		break;
+	case kVAR:
+		// a name followed by ( is always a call, as parse.y resolves it
+		if (parser->next.type != kLPAREN) {
+			id = createVariable(stmt, intern(parser));
+			break;
+		}
+
+		name = intern(parser);
+		advance(parser);
+		advance(parser);
+
+		if (parser->token.type != kRPAREN) {
+			push(parser, fCALL)->name = name;
+			expression(parser, 1);
+			return mOPERAND;
+		}
+
+		id = createCall(stmt, name, createNil(stmt));
+		break;
+	case kLBRACKET:
+		if ((id = array(parser)) == NO_NODE)
+			return mFAIL;
+
+		take(parser, id);
+		return mOPERATOR;
+	case kLPAREN:
+		// (bool) is only a bool where one could go anyway, and then it's all there is
+		allowBool = level->allowBool && empty(level);
+		advance(parser);
+
+		push(parser, fGROUP);
+		expression(parser, allowBool);
+		return mOPERAND;
+	case kTRUE:
+	case kFALSE:
+		if (!level->allowBool || !empty(level))
+			return reject(parser);
+
+		level->left = createBoolTerminal(stmt, parser->token.type == kTRUE);
+		advance(parser);
+		return mFINISH;
+	default:
+		return reject(parser);
+	}
+
+	advance(parser);
+	take(parser, id);
+	return mOPERATOR;
+}
+
+// after an operand: another operator, or the end of the expression
+static Mode infix(Parser *parser) {
+	Frame *level = &parser->frames[parser->depth - 1];
+	TokenType type = parser->token.type;
+
+	switch(precedence(type)) {
+	case ARITHMETIC:
+		level->op = type;
+		break;
+	case COMPARISON:
+		// a comparison is a bool, which nothing takes as an operand
+		if (!level->allowBool || level->compared != NO_NODE)
+			return mFINISH;
+
+		level->compared = level->left;
+		level->comparison = type;
+		level->left = NO_NODE;
+		break;
+	default:
+		return mFINISH;
+	}
+
+	advance(parser);
+	return mOPERAND;
+}
+
+// the value of the finished statement, once it's closed everything it completes up to an
+// else that starts another branch
+static Mode closeStatements(Parser *parser, NodeId *value) {
+	Statement *stmt = parser->stmt;
+	Frame *frame;
+
+	while (parser->depth > 0) {
+		frame = &parser->frames[parser->depth - 1];
+
+		if (frame->type == fASSIGN) {
+			*value = createAssign(stmt, createVariable(stmt, frame->name), *value);
+		} else if (frame->type == fDEF) {
+			*value = createDef(stmt, frame->name, frame->cond, *value);
+		} else if (frame->type == fFOR && parser->token.type == kEND) {
+			advance(parser);
+			*value = createFor(stmt, createVariable(stmt, frame->name), frame->cond, frame->then, *value);
+		} else if (frame->type == fTHEN && parser->token.type == kELSE) {
+			frame->type = fELSE;
+			frame->then = *value;
+			advance(parser);
+			return mSTATEMENT;
+		} else if (parser->token.type != kEND) {
+			return reject(parser);
+		} else {
+			advance(parser);
+
+			if (frame->type == fTHEN)
+				*value = createIf(stmt, frame->cond, *value);
+			else
+				*value = createIfElse(stmt, frame->cond, frame->then, *value);
+		}
+
+		parser->depth--;
+	}
+
+	return mDONE;
+}
+
+// the innermost expression is done: hand its value to whatever it's in
+static Mode finish(Parser *parser, NodeId *value) {
+	Statement *stmt = parser->stmt;
+	Frame *level = &parser->frames[--parser->depth], *frame;
+	NodeId list;
+
+	if (level->compared != NO_NODE)
+		*value = combine(stmt, level->comparison, level->compared, level->left);
+	else
+		*value = level->left;
+
+	if (parser->depth == 0)
+		return closeStatements(parser, value);
+
+	frame = &parser->frames[parser->depth - 1];
+
+	switch(frame->type) {
+	case fGROUP:
+		if (parser->token.type != kRPAREN)
+			return reject(parser);
+		advance(parser);
+
+		parser->depth--;
+		take(parser, *value);
+
+		// a bool in parentheses ends the expression it's in
+		return isBool(stmt, *value) ? mFINISH : mOPERATOR;
+	case fCALL:
+	case fITEM:
+		if (parser->token.type == kCOMMA) {
+			advance(parser);
+
+			push(parser, fITEM)->cond = *value;
+			expression(parser, 1);
+			return mOPERAND;
+		}
+
+		if (parser->token.type != kRPAREN)
+			return reject(parser);
+
+		// the last argument and the nil after it first, as bison reduces them
+		list = createList(stmt, *value, createNil(stmt));
+
+		while (parser->frames[parser->depth - 1].type == fITEM)
+			list = createList(stmt, parser->frames[--parser->depth].cond, list);
+
+		*value = createCall(stmt, parser->frames[--parser->depth].name, list);
+		advance(parser);
+
+		take(parser, *value);
+		return mOPERATOR;
+	case fCOND:
+		if (!isBool(stmt, *value) || parser->token.type != kTHEN)
+			return reject(parser);
+		advance(parser);
+
+		frame->type = fTHEN;
+		frame->cond = *value;
+		return mSTATEMENT;
+	case fFROM:
+		if (parser->token.type != kRANGE)
+			return reject(parser);
+		advance(parser);
+
+		frame->type = fTO;
+		frame->cond = *value;
+
+		expression(parser, 0);
+		return mOPERAND;
+	case fTO:
+		if (parser->token.type != kDO)
+			return reject(parser);
+		advance(parser);
+
+		frame->type = fFOR;
+		frame->then = *value;
+		return mSTATEMENT;
+	default:
+		return closeStatements(parser, value);
+	}
+}
+
+static NodeId statement(Parser *parser) {
+	NodeId value = NO_NODE;
+	Mode mode = mSTATEMENT;
+
+	while (1) {
+		switch(mode) {
+		case mSTATEMENT:
+			mode = begin(parser);
+			break;
+		case mOPERAND:
+			mode = operand(parser);
+			break;
+		case mOPERATOR:
+			mode = infix(parser);
+			break;
+		case mFINISH:
+			mode = finish(parser, &value);
+			break;
+		case mDONE:
+			return value;
+		default:
+			return NO_NODE;
+		}
+	}
+}
+
+int scanStatement(Statement *stmt, const char *text, size_t length) {
+	Parser parser;
+	NodeId root = 0;
+
+	parser.stmt = stmt;
+	parser.scanner.text = text;
+	parser.scanner.length = length;
+	parser.scanner.at = 0;
+	parser.scanner.line = 1;
+
+	parser.frames = parser.smallFrames;
+	parser.depth = 0;
+	parser.capacity = SMALL_FRAMES;
+
+	scan(&parser.scanner, &parser.token);
+	scan(&parser.scanner, &parser.next);
+
+	while (parser.token.type != kEND_OF_INPUT) {
+		if ((root = statement(&parser)) == NO_NODE)
+			break;
+
+		addRoot(stmt, root);
+	}
+
+	if (parser.frames != parser.smallFrames)
+		free(parser.frames);
+
+	return root != NO_NODE;
+}
@@ -0,0 +1,17 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include "stmt.h"
+
+#include <stddef.h>
+
+// The hand-written front end (make FRONTEND=scan): a scanner that hands out tokens as slices
+// of the text and an operator precedence parser over them, which nests with a stack of its
+// own. It builds exactly the nodes parse.y does, in the same order, so nothing after it can
+// tell the two apart.
+//
+// Parses length bytes of text (which needn't be NUL-terminated) into stmt, appending its
+// top-level statements. Returns 0 on a syntax error, recorded in stmt the same way bison's is.
+int scanStatement(Statement *stmt, const char *text, size_t length);
+
+#endif
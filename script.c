@@ -0,0 +1,120 @@
+#include "script.h"
+#include "eval.h"
+#include "stmt.h"
+#include "terp.h"
+#include "cache.h"
+#include "terpc.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+char *mapScript(const char *file, size_t *size, size_t *mapped) {
+	struct stat info;
+	char *buffer;
+	int fd = open(file, O_RDONLY);
+
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &info) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	*size = info.st_size;
+	*mapped = *size + 2;
+
+	// reserve zeroed memory for the file plus its terminator, then map the file over the front of it.
+	// the pages are private and writable because flex pokes NULs into the buffer while scanning.
+	buffer = mmap(NULL, *mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (buffer == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	if (*size > 0 && mmap(buffer, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(buffer, *mapped);
+		close(fd);
+		return NULL;
+	}
+
+	// the mapping stays valid after the descriptor is gone
+	close(fd);
+
+	return buffer;
+}
+
+void unmapScript(char *buffer, size_t mapped) {
+	munmap(buffer, mapped);
+}
+
+int interpretScript(char *file, State *state) {
+	Statement *program, *recycled;
+	CacheEntry *entry = NULL;
+	size_t size, mapped;
+	uint64_t hash = 0;
+	char *buffer;
+	int i;
+
+	/* Map the script file specified on the command line */
+	buffer = mapScript(file, &size, &mapped);
+
+	if (buffer == NULL) {
+		error(state, "Could not open script!");
+		return 0;
+	}
+
+	/* Running the same script again in this State reuses its parsed program (the text is the key,
+	so a script with a NUL byte in it can't be cached) */
+	if (state->cache != NULL && strlen(buffer) == size)
+		entry = cacheLookup(state->cache, buffer);
+
+	if (entry != NULL) {
+		for (i = 0; i < entry->stmt->rootCount; i++)
+			evaluateEntry(entry, i, state);
+
+		unmapScript(buffer, mapped);
+		return 1;
+	}
+
+	program = newStatement();
+
+	/* Hashed now, the scanner writes into the buffer */
+	if (state->precompiled)
+		hash = sourceHash(buffer, size);
+
+	/* One scanner and parser for the whole file; statements may span lines. Skipped when an
+	earlier run left the parsed program behind in a .terpc file. */
+	if (!state->precompiled || !loadPrecompiled(file, hash, size, program)) {
+		if (!buildProgram(buffer, size, program)) {
+			reportSyntaxError(program, state);
+			deleteStatement(program);
+			unmapScript(buffer, mapped);
+			return 0;
+		}
+
+		if (state->precompiled)
+			savePrecompiled(file, hash, size, program);
+	}
+
+	resolveStatement(program, state);
+
+	/* Don't care about the return value of each statement, the script will handle its own output. */
+	for (i = 0; i < program->rootCount; i++)
+		evaluateStatement(program, program->roots[i], state);
+
+	if (state->cache != NULL && strlen(buffer) == size) {
+		cacheInsert(state->cache, buffer, program, &recycled);
+		deleteStatement(recycled);
+	} else {
+		deleteStatement(program);
+	}
+
+	unmapScript(buffer, mapped);
+	return 1;
+}
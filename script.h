@@ -0,0 +1,17 @@
+#ifndef __SCRIPT_H__
+#define __SCRIPT_H__
+
+#include "terp.h"
+
+#include <stddef.h>
+
+// Map a file into memory followed by two NUL bytes, so the scanner can work on it in place.
+// Returns NULL if the file can't be opened; *mapped is what unmapScript() needs.
+char *mapScript(const char *file, size_t *size, size_t *mapped);
+void unmapScript(char *buffer, size_t mapped);
+
+// Parse a whole script in one go and run its statements in order. Returns 0 (after reporting
+// why to state) if it can't be opened or parsed.
+int interpretScript(char *file, State *state);
+
+#endif
@@ -0,0 +1,378 @@
+#include "server.h"
+#include "eval.h"
+#include "value.h"
+#include "reactive.h"
+#include "function.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// a connection's requests wait while it has this much output the client hasn't read yet
+#define OUTPUT_LIMIT (1 << 20)
+
+#define READ_SIZE 65536
+#define MAX_EVENTS 64
+
+typedef struct tagBuffer {
+	char *data;
+	size_t length;
+	size_t capacity;
+} Buffer;
+
+typedef struct tagConnection {
+	int fd;
+	State *state;
+
+	// bytes read that don't make up a whole request yet
+	Buffer in;
+
+	// responses, sent from sent onwards
+	Buffer out;
+	size_t sent;
+
+	// the epoll events asked for
+	uint32_t events;
+
+	// the client has stopped sending (or sent something it shouldn't): close once everything
+	// it did send is answered
+	int closing;
+
+	struct tagConnection *prev;
+	struct tagConnection *next;
+} Connection;
+
+typedef struct tagServer {
+	int listener;
+	int epoll;
+
+	State *like;
+	int shared;
+
+	Connection *connections;
+} Server;
+
+static volatile sig_atomic_t stopping;
+
+static void stop(int signal) {
+	(void)signal;
+	stopping = 1;
+}
+
+// room for at least n more bytes
+static void reserve(Buffer *buffer, size_t n) {
+	if (buffer->length + n <= buffer->capacity)
+		return;
+
+	while (buffer->length + n > buffer->capacity)
+		buffer->capacity = buffer->capacity ? buffer->capacity * 2 : READ_SIZE;
+
+	buffer->data = (char *)realloc(buffer->data, buffer->capacity);
+}
+
+static void respond(Connection *conn, char status, const char *text, size_t length) {
+	uint32_t size = (uint32_t)length + 1;
+	unsigned char *header;
+
+	reserve(&conn->out, 5 + length);
+
+	header = (unsigned char *)conn->out.data + conn->out.length;
+	header[0] = size >> 24;
+	header[1] = size >> 16;
+	header[2] = size >> 8;
+	header[3] = size;
+	header[4] = status;
+
+	memcpy(conn->out.data + conn->out.length + 5, text, length);
+	conn->out.length += 5 + length;
+}
+
+// a new session starts with the values of everything defined in like (not definitions, in
+// reactive mode), the way an image would give them to it, and with like's functions
+static State *newSession(State *like) {
+	State *state = initStateLike(like);
+	Symbol *symbol;
+	int i, from, to;
+
+	for (i = symbolNext(like->symbols, -1); i >= 0; i = symbolNext(like->symbols, i)) {
+		symbol = &like->symbols->symbols[i];
+		from = symbol->value;
+
+		if (!like->slots[from].defined)
+			continue;
+
+		refreshSlot(like, from);
+
+		to = lookupSlot(state, symbol->key);
+		state->slots[to].value = copyValue(state, like->slots[from].value);
+		state->slots[to].defined = 1;
+	}
+
+	copyFunctions(state, like);
+
+	state->out = NULL;
+	return state;
+}
+
+static void answer(Connection *conn, char *source) {
+	State *state = conn->state;
+	Element result;
+	char *text = NULL;
+	size_t length = 0;
+	FILE *out = open_memstream(&text, &length);
+	int errors = state->errors, evaluated;
+
+	// error messages go straight into the response
+	state->out = out;
+	evaluated = evaluateLine(source, state, &result);
+
+	if (evaluated && state->errors == errors)
+		printValue(out, result);
+
+	state->out = NULL;
+	fclose(out);
+
+	respond(conn, state->errors == errors ? ':' : '!', text, length);
+	free(text);
+}
+
+// answer every whole request that's been read, returns 1 if some have to wait for the
+// client to read what it's been sent
+static int handleRequests(Connection *conn) {
+	unsigned char *header;
+	size_t at = 0;
+	uint32_t length;
+	char next;
+	int blocked = 0;
+
+	while (conn->in.length - at >= 4) {
+		header = (unsigned char *)conn->in.data + at;
+		length = (uint32_t)header[0] << 24 | header[1] << 16 | header[2] << 8 | header[3];
+
+		if (length > SERVE_MAX_REQUEST) {
+			respond(conn, '!', "Request too large\n", 18);
+			conn->closing = 1;
+			at = conn->in.length;
+			break;
+		}
+
+		if (conn->in.length - at - 4 < length)
+			break;
+
+		if (conn->out.length - conn->sent >= OUTPUT_LIMIT) {
+			blocked = 1;
+			break;
+		}
+
+		// the scanner wants a string, borrow the byte after it (there's always one, see
+		// readRequests())
+		next = conn->in.data[at + 4 + length];
+		conn->in.data[at + 4 + length] = '\0';
+		answer(conn, conn->in.data + at + 4);
+		conn->in.data[at + 4 + length] = next;
+
+		at += 4 + length;
+	}
+
+	memmove(conn->in.data, conn->in.data + at, conn->in.length - at);
+	conn->in.length -= at;
+
+	return blocked;
+}
+
+// read whatever has arrived, 0 if the connection is broken
+static int readRequests(Connection *conn) {
+	ssize_t n;
+
+	while (1) {
+		reserve(&conn->in, READ_SIZE + 1);
+		n = read(conn->fd, conn->in.data + conn->in.length, READ_SIZE);
+
+		if (n > 0) {
+			conn->in.length += n;
+		} else if (n == 0) {
+			conn->closing = 1;
+			return 1;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 1;
+		} else if (errno != EINTR) {
+			return 0;
+		}
+	}
+}
+
+// send as much as the socket will take, 0 if the connection is broken
+static int sendResponses(Connection *conn) {
+	ssize_t n;
+
+	while (conn->sent < conn->out.length) {
+		n = send(conn->fd, conn->out.data + conn->sent, conn->out.length - conn->sent, MSG_NOSIGNAL);
+
+		if (n > 0)
+			conn->sent += n;
+		else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 1;
+		else if (n < 0 && errno != EINTR)
+			return 0;
+	}
+
+	conn->out.length = conn->sent = 0;
+	return 1;
+}
+
+static void dropConnection(Server *server, Connection *conn) {
+	epoll_ctl(server->epoll, EPOLL_CTL_DEL, conn->fd, NULL);
+	close(conn->fd);
+
+	if (!server->shared)
+		freeState(conn->state);
+
+	if (conn->prev != NULL)
+		conn->prev->next = conn->next;
+	else
+		server->connections = conn->next;
+	if (conn->next != NULL)
+		conn->next->prev = conn->prev;
+
+	free(conn->in.data);
+	free(conn->out.data);
+	free(conn);
+}
+
+static void acceptConnections(Server *server) {
+	struct epoll_event event;
+	Connection *conn;
+	int fd;
+
+	while ((fd = accept(server->listener, NULL, NULL)) >= 0) {
+		fcntl(fd, F_SETFL, O_NONBLOCK);
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		conn = (Connection *)calloc(1, sizeof(Connection));
+		conn->fd = fd;
+		conn->state = server->shared ? server->like : newSession(server->like);
+		conn->events = EPOLLIN;
+
+		conn->next = server->connections;
+		if (conn->next != NULL)
+			conn->next->prev = conn;
+		server->connections = conn;
+
+		event.events = conn->events;
+		event.data.ptr = conn;
+		epoll_ctl(server->epoll, EPOLL_CTL_ADD, fd, &event);
+	}
+}
+
+static void service(Server *server, Connection *conn, uint32_t events) {
+	struct epoll_event event;
+	int blocked;
+
+	if ((events & EPOLLIN) && !readRequests(conn)) {
+		dropConnection(server, conn);
+		return;
+	}
+
+	// answering can free up room for more answers if the client is reading as fast as we send
+	do {
+		blocked = handleRequests(conn);
+
+		if (!sendResponses(conn)) {
+			dropConnection(server, conn);
+			return;
+		}
+	} while (blocked && conn->out.length == 0);
+
+	if (conn->closing && !blocked && conn->out.length == 0) {
+		dropConnection(server, conn);
+		return;
+	}
+
+	// stop reading from a client that isn't reading its responses
+	event.events = (blocked || conn->closing ? 0 : EPOLLIN) | (conn->out.length > 0 ? EPOLLOUT : 0);
+	event.data.ptr = conn;
+
+	if (event.events != conn->events) {
+		conn->events = event.events;
+		epoll_ctl(server->epoll, EPOLL_CTL_MOD, conn->fd, &event);
+	}
+}
+
+static int listenAt(Server *server, const char *path) {
+	struct sockaddr_un address = { AF_UNIX };
+	struct epoll_event event;
+	struct stat info;
+
+	if (strlen(path) >= sizeof address.sun_path) {
+		error(server->like, "Socket path too long");
+		return 0;
+	}
+
+	strcpy(address.sun_path, path);
+
+	// left behind by a server that didn't get to clean up
+	if (stat(path, &info) == 0 && S_ISSOCK(info.st_mode))
+		unlink(path);
+
+	server->listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+	if (server->listener < 0 || bind(server->listener, (struct sockaddr *)&address, sizeof address) < 0
+		|| listen(server->listener, SOMAXCONN) < 0) {
+		error(server->like, "Could not listen on socket");
+		return 0;
+	}
+
+	server->epoll = epoll_create1(EPOLL_CLOEXEC);
+
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	epoll_ctl(server->epoll, EPOLL_CTL_ADD, server->listener, &event);
+
+	return 1;
+}
+
+int serve(const char *path, State *like, int shared) {
+	Server server = { -1, -1, like, shared, NULL };
+	struct epoll_event events[MAX_EVENTS];
+	struct sigaction action = { 0 };
+	int i, n, ok;
+
+	if ((ok = listenAt(&server, path))) {
+		// no SA_RESTART, so a signal wakes epoll_wait() up
+		action.sa_handler = stop;
+		sigaction(SIGINT, &action, NULL);
+		sigaction(SIGTERM, &action, NULL);
+
+		while (!stopping) {
+			n = epoll_wait(server.epoll, events, MAX_EVENTS, -1);
+
+			for (i = 0; i < n; i++) {
+				if (events[i].data.ptr == NULL)
+					acceptConnections(&server);
+				else
+					service(&server, (Connection *)events[i].data.ptr, events[i].events);
+			}
+		}
+
+		while (server.connections != NULL)
+			dropConnection(&server, server.connections);
+
+		unlink(path);
+	}
+
+	if (server.epoll >= 0)
+		close(server.epoll);
+	if (server.listener >= 0)
+		close(server.listener);
+
+	return ok;
+}
@@ -0,0 +1,20 @@
+#ifndef __SERVER_H__
+#define __SERVER_H__
+
+#include "terp.h"
+
+// terp --serve: answer statements sent over a Unix domain socket, from any number of clients
+// at once. Every message either way is a 4 byte length (big endian) followed by that many
+// bytes. A request is a line to evaluate, the same as one typed at the prompt; its response
+// is ':' and the value as the REPL shows it, or '!' and the error messages, one per line.
+// Requests can be sent without waiting for responses, which come back in the same order.
+//
+// Each connection gets its own session, starting with like's settings and copies of its
+// variables, or with shared set they all use like itself.
+#define SERVE_MAX_REQUEST (16 << 20)
+
+// Listen at path until interrupted (SIGINT or SIGTERM). Returns 0, after reporting why to
+// like, if the socket can't be set up.
+int serve(const char *path, State *like, int shared);
+
+#endif
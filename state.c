@@ -0,0 +1,207 @@
+#include "terp.h"
+#include "cache.h"
+#include "array.h"
+#include "bigint.h"
+#include "value.h"
+#include "image.h"
+#include "reactive.h"
+#include "function.h"
+
+#include <stdlib.h>
+
+State *initState() {
+	State *ret = (State *)malloc(sizeof(State));
+	ret->symbols = newSymbolTable();
+	ret->slots = NULL;
+	ret->slotCount = 0;
+	ret->slotCapacity = 0;
+	ret->functionNames = newSymbolTable();
+	ret->functions = NULL;
+	ret->functionCount = 0;
+	ret->functionCapacity = 0;
+	ret->frame = NULL;
+	ret->frameSize = 0;
+	ret->callDepth = 0;
+	ret->scratch = newStatement();
+	ret->cache = newCache(DEFAULT_CACHE_SIZE);
+	ret->treeWalk = 0;
+	ret->jit = 1;
+	ret->reactive = 0;
+	ret->precompiled = 1;
+	ret->heap = NULL;
+	ret->heapCount = 0;
+	ret->heapCapacity = 0;
+	ret->heapBytes = 0;
+	ret->heapPeak = 0;
+	ret->heapLimit = HEAP_COLLECT_MIN;
+	ret->heapByteLimit = HEAP_COLLECT_BYTES;
+	ret->out = stdout;
+	ret->errors = 0;
+	ret->lastError[0] = '\0';
+	ret->image = NULL;
+
+	return ret;
+}
+
+State *initStateLike(State *like) {
+	State *ret = initState();
+
+	ret->treeWalk = like->treeWalk;
+	ret->jit = like->jit;
+	ret->reactive = like->reactive;
+	ret->precompiled = like->precompiled;
+	ret->image = like->image;
+
+	if (like->cache == NULL || like->cache->capacity != DEFAULT_CACHE_SIZE) {
+		freeCache(ret->cache);
+		ret->cache = like->cache != NULL ? newCache(like->cache->capacity) : NULL;
+	}
+
+	return ret;
+}
+
+void error(State *state, char *msg) {
+	if (state == NULL)
+		return;
+
+	state->errors++;
+	snprintf(state->lastError, sizeof state->lastError, "%s", msg);
+
+	if (state->out != NULL)
+		fprintf(state->out, "%s\n", msg);
+}
+
+// convenience function for "is this variable defined"
+int exists(State *state, char *name) {
+	int *slot = symbolLookup(state->symbols, name);
+
+	if (slot == NULL)
+		return state->image != NULL && imageLookup(state->image, state, name, NULL);
+
+	return state->slots[*slot].defined;
+}
+
+int lookupSlot(State *state, const char *name) {
+	int created;
+	int *slot = symbolInsert(state->symbols, name, &created);
+
+	if (!created)
+		return *slot;
+
+	if (state->slotCount == state->slotCapacity) {
+		state->slotCapacity = state->slotCapacity ? state->slotCapacity * 2 : 16;
+		state->slots = (Slot *)realloc(state->slots, state->slotCapacity * sizeof(Slot));
+	}
+
+	state->slots[state->slotCount].value = NIL;
+	state->slots[state->slotCount].defined = 0;
+	state->slots[state->slotCount].cell = NULL;
+
+	// first sight of a name the image has
+	if (state->image != NULL && imageLookup(state->image, state, name, &state->slots[state->slotCount].value))
+		state->slots[state->slotCount].defined = 1;
+
+	*slot = state->slotCount;
+	return state->slotCount++;
+}
+
+Element keepValue(State *state, Element value) {
+	if (state == NULL)
+		return value;
+
+	if (state->heapCount == state->heapCapacity) {
+		state->heapCapacity = state->heapCapacity ? state->heapCapacity * 2 : 16;
+		state->heap = (Element *)realloc(state->heap, state->heapCapacity * sizeof(Element));
+	}
+
+	state->heap[state->heapCount++] = value;
+
+	state->heapBytes += valueSize(value);
+	if (state->heapBytes > state->heapPeak)
+		state->heapPeak = state->heapBytes;
+
+	return value;
+}
+
+// where a heap value keeps its mark
+static int *mark(Element value) {
+	return value.type == tSET ? &value.value.array->marked : &value.value.big->marked;
+}
+
+// set (or clear) the marks of everything the variables, the current call and keep hold
+static void markRoots(State *state, Element keep, int marked) {
+	Slot *slot;
+	int i;
+
+	for (i = 0; i < state->slotCount; i++) {
+		slot = &state->slots[i];
+
+		if (slot->defined && (slot->value.type == tSET || slot->value.type == tBIG))
+			*mark(slot->value) = marked;
+	}
+
+	for (i = 0; i < state->frameSize; i++) {
+		if (state->frame[i].type == tSET || state->frame[i].type == tBIG)
+			*mark(state->frame[i]) = marked;
+	}
+
+	if (keep.type == tSET || keep.type == tBIG)
+		*mark(keep) = marked;
+}
+
+// free the unmarked values from heap[from] on, clearing the marks of the rest
+static void sweep(State *state, int from) {
+	int i, kept = from;
+
+	for (i = from; i < state->heapCount; i++) {
+		if (*mark(state->heap[i])) {
+			*mark(state->heap[i]) = 0;
+			state->heap[kept++] = state->heap[i];
+		} else {
+			state->heapBytes -= valueSize(state->heap[i]);
+			freeValue(state->heap[i]);
+		}
+	}
+
+	state->heapCount = kept;
+
+	// don't come back until there's as much garbage again as there is live data
+	state->heapLimit = kept * 2 > HEAP_COLLECT_MIN ? kept * 2 : HEAP_COLLECT_MIN;
+	state->heapByteLimit = state->heapBytes * 2 > HEAP_COLLECT_BYTES ? state->heapBytes * 2 : HEAP_COLLECT_BYTES;
+}
+
+void collectGarbage(State *state) {
+	if (!COLLECTION_DUE(state))
+		return;
+
+	markRoots(state, NIL, 1);
+	sweep(state, 0);
+}
+
+void collectLoopGarbage(State *state, int since, Element keep) {
+	markRoots(state, keep, 1);
+	sweep(state, since);
+
+	// roots from before the loop weren't swept, so they're still marked
+	markRoots(state, keep, 0);
+}
+
+void freeState(State *state) {
+	int i;
+
+	freeSymbolTable(state->symbols);
+
+	for (i = 0; i < state->slotCount; i++)
+		freeCell(state->slots[i].cell);
+
+	free(state->slots);
+	freeFunctions(state);
+	deleteStatement(state->scratch);
+	freeCache(state->cache);
+
+	for (i = 0; i < state->heapCount; i++)
+		freeValue(state->heap[i]);
+	free(state->heap);
+
+	free(state);
+}
@@ -0,0 +1,125 @@
+#include "stats.h"
+
+#ifdef TERP_STATS
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+_Thread_local Stats terpStats;
+
+// counters handed over by threads that have finished
+static Stats merged;
+static pthread_mutex_t mergeLock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *typeNames[] = {
+	[sASSIGN] = "assign",
+	[sIF] = "if",
+	[sIFELSE] = "ifelse",
+	[sBOOL] = "bool",
+	[sBOOLVAL] = "boolval",
+	[sINT] = "int",
+	[sVAR] = "var",
+	[sARITH] = "arith",
+	[sNIL] = "nil",
+	[sREAL] = "real",
+	[sARRAY] = "array",
+	[sBIG] = "big",
+	[sDEF] = "def",
+	[sCALL] = "call",
+	[sLIST] = "list",
+	[sFOR] = "for",
+	[sPARAM] = "param"
+};
+
+uint64_t statsNow(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#define MERGE(field) (into->field += from->field)
+
+static void addStats(Stats *into, const Stats *from) {
+	int i;
+
+	for (i = 0; i < STMT_TYPES; i++)
+		MERGE(evaluations[i]);
+
+	MERGE(executions);
+	MERGE(instructions);
+	MERGE(deopts);
+	MERGE(jitCompiles);
+	MERGE(jitRuns);
+	MERGE(jitBailouts);
+	MERGE(recomputes);
+	MERGE(invalidations);
+	MERGE(loops);
+	MERGE(reducedIterations);
+	MERGE(nodes);
+	MERGE(nodeGrows);
+	MERGE(stackAllocs);
+	MERGE(lookups);
+	MERGE(probedGroups);
+	MERGE(resizes);
+	MERGE(parseTime);
+	MERGE(compileTime);
+	MERGE(evalTime);
+	MERGE(parses);
+	MERGE(statements);
+}
+
+void mergeStats(void) {
+	pthread_mutex_lock(&mergeLock);
+	addStats(&merged, &terpStats);
+	pthread_mutex_unlock(&mergeLock);
+
+	memset(&terpStats, 0, sizeof terpStats);
+}
+
+void printStats(FILE *out) {
+	Stats total = terpStats, *s = &total;
+	int i;
+
+	pthread_mutex_lock(&mergeLock);
+	addStats(&total, &merged);
+	pthread_mutex_unlock(&mergeLock);
+
+	fprintf(out, "time: parse %.3f ms (%lu parses), eval %.3f ms (%lu statements, %.3f ms compiling)\n",
+		s->parseTime / 1e6, s->parses, s->evalTime / 1e6, s->statements, s->compileTime / 1e6);
+
+	fprintf(out, "evaluate():");
+	for (i = 0; i < STMT_TYPES; i++)
+		fprintf(out, " %s %lu", typeNames[i], s->evaluations[i]);
+	fprintf(out, "\n");
+
+	fprintf(out, "vm: %lu executions, %lu instructions, %lu deopts\n",
+		s->executions, s->instructions, s->deopts);
+
+	fprintf(out, "jit: %lu statements compiled, %lu native runs, %lu bailouts\n",
+		s->jitCompiles, s->jitRuns, s->jitBailouts);
+
+	fprintf(out, "reactive: %lu recomputed, %lu marked out of date\n",
+		s->recomputes, s->invalidations);
+
+	fprintf(out, "loops: %lu run, %lu iterations as reductions\n",
+		s->loops, s->reducedIterations);
+
+	fprintf(out, "allocation: %lu nodes, %lu arena grows, %lu heap stacks\n",
+		s->nodes, s->nodeGrows, s->stackAllocs);
+
+	fprintf(out, "symbols: %lu lookups, %.2f groups probed per lookup, %lu resizes\n",
+		s->lookups, s->lookups ? (double)s->probedGroups / s->lookups : 0.0, s->resizes);
+}
+
+#else
+
+void printStats(FILE *out) {
+	fprintf(out, "stats not compiled in (build with `make stats`)\n");
+}
+
+void mergeStats(void) {
+}
+
+#endif
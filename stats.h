@@ -0,0 +1,84 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include "stmt.h"
+
+#include <stdio.h>
+
+// Instrumentation counters, only compiled in with -DTERP_STATS (`make stats`).
+// Without it every STAT_* macro compiles to nothing.
+#ifdef TERP_STATS
+
+#include <stdint.h>
+
+typedef struct tagStats {
+	// evaluate() calls by node type
+	unsigned long evaluations[STMT_TYPES];
+
+	// bytecode
+	unsigned long executions;
+	unsigned long instructions;
+	unsigned long deopts;
+
+	// native code
+	unsigned long jitCompiles;
+	unsigned long jitRuns;
+	unsigned long jitBailouts;
+
+	// reactive mode: definitions run again, and marked out of date
+	unsigned long recomputes;
+	unsigned long invalidations;
+
+	// for loops started, and iterations run a chunk at a time as reductions
+	unsigned long loops;
+	unsigned long reducedIterations;
+
+	// allocations: nodes handed out by allocateNode() and the arena growth behind them,
+	// plus VM stacks too deep for the C stack
+	unsigned long nodes;
+	unsigned long nodeGrows;
+	unsigned long stackAllocs;
+
+	// symbol tables (variables and the statement cache's index)
+	unsigned long lookups;
+	unsigned long probedGroups;
+	unsigned long resizes;
+
+	// wall time, in nanoseconds
+	uint64_t parseTime;
+	uint64_t compileTime;
+	uint64_t evalTime;
+	unsigned long parses;
+	unsigned long statements;
+} Stats;
+
+// each thread counts for itself, see mergeStats()
+extern _Thread_local Stats terpStats;
+
+uint64_t statsNow(void);
+
+#define STAT_INC(field) (terpStats.field++)
+#define STAT_ADD(field, n) (terpStats.field += (n))
+
+// STAT_CLOCK declares a start time, STAT_ELAPSED adds the time since then to a field
+#define STAT_CLOCK(start) uint64_t start = statsNow()
+#define STAT_ELAPSED(field, start) (terpStats.field += statsNow() - (start))
+
+#else
+
+// still expressions, so `if (x) STAT_INC(y);` isn't an empty body
+#define STAT_INC(field) ((void)0)
+#define STAT_ADD(field, n) ((void)0)
+#define STAT_CLOCK(start)
+#define STAT_ELAPSED(field, start) ((void)0)
+
+#endif
+
+// Write the counters of the calling thread and of every thread that has called mergeStats()
+// (or a note that they weren't compiled in)
+void printStats(FILE *out);
+
+// Hand the calling thread's counters over to printStats() before the thread goes away
+void mergeStats(void);
+
+#endif
@@ -1,152 +1,468 @@
+
 #include "stmt.h"
+#include "stats.h"
+#include "array.h"
+#include "bigint.h"
+#include "value.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+
+const int stmtArity[] = {
+	[sASSIGN] = 2,
+	[sIF] = 2,
+	[sIFELSE] = 3,
+	[sBOOL] = 2,
+	[sBOOLVAL] = 0,
+	[sINT] = 0,
+	[sVAR] = 0,
+	[sARITH] = 2,
+	[sNIL] = 0,
+	[sREAL] = 0,
+	[sARRAY] = 0,
+	[sBIG] = 0,
+	[sDEF] = 2,
+	[sCALL] = 1,
+	[sLIST] = 2,
+	[sFOR] = 4,
+	[sPARAM] = 0
+};
+
+Statement *newStatement() {
+	return (Statement *)calloc(1, sizeof(Statement));
+}
 
-ParseNode *allocateNode(int childNum) {
-	ParseNode *node = (ParseNode *)malloc(sizeof *node);
+static void freeLiterals(Statement *stmt) {
+	int i;
 
-	// child nodes
-	if (childNum != 0) {
-		node->children = (ParseNode **)malloc((childNum+1)*sizeof(ParseNode *));
-		// add null pointer for great justice (and also to avoid segfaults)
-		node->children[childNum] = NULL;
-	} else {
-		node->children = NULL;
+	for (i = 0; i < stmt->literalCount; i++)
+		freeValue(stmt->literals[i]);
+
+	stmt->literalCount = 0;
+}
+
+void addLiteral(Statement *stmt, Element literal) {
+	if (stmt->literalCount == stmt->literalCapacity) {
+		stmt->literalCapacity = stmt->literalCapacity ? stmt->literalCapacity * 2 : 4;
+		stmt->literals = (Element *)realloc(stmt->literals, stmt->literalCapacity * sizeof(Element));
+	}
+
+	stmt->literals[stmt->literalCount++] = literal;
+}
+
+// go back to buffers of our own, a mapped file can't grow
+static void unmap(Statement *stmt) {
+	if (stmt->mapping == NULL)
+		return;
+
+	munmap(stmt->mapping, stmt->mappingSize);
+	stmt->mapping = NULL;
+
+	stmt->nodes = NULL;
+	stmt->names = NULL;
+	stmt->roots = NULL;
+	stmt->capacity = stmt->namesCapacity = stmt->rootCapacity = 0;
+}
+
+void resetStatement(Statement *stmt) {
+	freeLiterals(stmt);
+	unmap(stmt);
+
+	stmt->count = 0;
+	stmt->namesLength = 0;
+	stmt->rootCount = 0;
+	stmt->syntaxError = NULL;
+}
+
+void addRoot(Statement *stmt, NodeId root) {
+	if (stmt->rootCount == stmt->rootCapacity) {
+		stmt->rootCapacity = stmt->rootCapacity ? stmt->rootCapacity * 2 : 4;
+		stmt->roots = (NodeId *)realloc(stmt->roots, stmt->rootCapacity * sizeof(NodeId));
+	}
+
+	stmt->roots[stmt->rootCount++] = root;
+}
+
+int internName(Statement *stmt, const char *name, int length) {
+	int offset = stmt->namesLength;
+
+	if (offset + length + 1 > stmt->namesCapacity) {
+		stmt->namesCapacity = (offset + length + 1) * 2;
+		stmt->names = (char *)realloc(stmt->names, stmt->namesCapacity);
 	}
 
-	return node;
+	memcpy(stmt->names + offset, name, length);
+	stmt->names[offset + length] = '\0';
+	stmt->namesLength += length + 1;
+
+	return offset;
+}
+
+// nodes are handed out by index, so growing the array never invalidates a reference
+NodeId allocateNode(Statement *stmt, StmtType type) {
+	ParseNode *node;
+	int i;
+
+	if (stmt->count == stmt->capacity) {
+		stmt->capacity = stmt->capacity ? stmt->capacity * 2 : 16;
+		stmt->nodes = (ParseNode *)realloc(stmt->nodes, stmt->capacity * sizeof(ParseNode));
+		STAT_INC(nodeGrows);
+	}
+
+	STAT_INC(nodes);
+
+	node = NODE(stmt, stmt->count);
+	memset(node, 0, sizeof *node);
+	node->sType = type;
+	node->name = -1;
+
+	for (i = 0; i < MAX_CHILDREN; i++)
+		node->children[i] = NO_NODE;
+
+	return stmt->count++;
 }
 
-ParseNode *createAssign(ParseNode *var, ParseNode *val) {
+NodeId createAssign(Statement *stmt, NodeId var, NodeId val) {
 	// 2 child nodes required
-	ParseNode *assign = allocateNode(2);
+	NodeId id = allocateNode(stmt, sASSIGN);
+	ParseNode *assign = NODE(stmt, id);
 
-	assign->sType = sASSIGN;
 	// assign takes value 0 (nil)
 	assign->vType = tNIL;
 
 	assign->children[0] = var;
 	assign->children[1] = val;
 
-	return assign;
+	return id;
 }
 
-ParseNode *createIf(ParseNode *cond, ParseNode *true) {
+NodeId createIf(Statement *stmt, NodeId cond, NodeId true) {
 	// 2 child nodes
-	ParseNode *stmt = allocateNode(2);
+	NodeId id = allocateNode(stmt, sIF);
+	ParseNode *node = NODE(stmt, id);
 
-	stmt->sType = sIF;
 	// will take value of true if cond is true, otherwise 0 (nil)
-	stmt->vType = true->vType;
+	node->vType = NODE(stmt, true)->vType;
 
-	stmt->children[0] = cond;
-	stmt->children[1] = true;
+	node->children[0] = cond;
+	node->children[1] = true;
 
-	return stmt;
+	return id;
 }
 
-ParseNode *createIfElse(ParseNode *cond, ParseNode *true, ParseNode *false) {
+NodeId createIfElse(Statement *stmt, NodeId cond, NodeId true, NodeId false) {
 	// 3 child nodes
-	ParseNode *stmt = allocateNode(3);
-
-	stmt->sType = sIFELSE;
+	NodeId id = allocateNode(stmt, sIFELSE);
+	ParseNode *node = NODE(stmt, id);
 
 	// takes value of true if cond is true false if cond is false (assume true->vType == false->vType for building tree)
-	stmt->vType = true->vType;
+	node->vType = NODE(stmt, true)->vType;
 
-	stmt->children[0] = cond;
-	stmt->children[1] = true;
-	stmt->children[2] = false;
+	node->children[0] = cond;
+	node->children[1] = true;
+	node->children[2] = false;
 
-	return stmt;
+	return id;
 }
 
-ParseNode *createBool(BoolOp op, ParseNode *left, ParseNode *right) {
+NodeId createBool(Statement *stmt, BoolOp op, NodeId left, NodeId right) {
 	// 2 children
-	ParseNode *stmt = allocateNode(2);
-
-	stmt->sType = sBOOL;
+	NodeId id = allocateNode(stmt, sBOOL);
+	ParseNode *node = NODE(stmt, id);
 
 	// can either be false or true (0 or 1)
-	stmt->vType = tBOOL;
-	stmt->value.boolean = 0;
+	node->vType = tBOOL;
+	node->value.boolean = 0;
 
-	stmt->op.boolop = op;
+	node->op.boolop = op;
 
-	stmt->children[0] = left;
-	stmt->children[1] = right;
+	node->children[0] = left;
+	node->children[1] = right;
 
-	return stmt;
+	return id;
 }
 
-ParseNode *createBoolTerminal(int value) {
-	ParseNode *stmt = allocateNode(0);
+NodeId createBoolTerminal(Statement *stmt, int value) {
+	NodeId id = allocateNode(stmt, sBOOLVAL);
+	ParseNode *node = NODE(stmt, id);
 
-	stmt->sType = sBOOL;
-	stmt->vType = tBOOL;
-	stmt->value.boolean = value;
+	node->vType = tBOOL;
+	node->value.boolean = value;
 
-	return stmt;
+	return id;
 }
 
-ParseNode *createInt(int value) {
-	ParseNode *stmt = allocateNode(0);
+NodeId createInt(Statement *stmt, int64_t value) {
+	NodeId id = allocateNode(stmt, sINT);
+	ParseNode *node = NODE(stmt, id);
 
-	stmt->sType = sINT;
+	node->vType = tINT;
+	node->value.integer = value;
 
-	stmt->vType = tINT;
-	stmt->value.integer = value;
+	return id;
+}
 
-	return stmt;
+NodeId createReal(Statement *stmt, double value) {
+	NodeId id = allocateNode(stmt, sREAL);
+	ParseNode *node = NODE(stmt, id);
+
+	node->vType = tREAL;
+	node->value.real = value;
+
+	return id;
+}
+
+NodeId createBig(Statement *stmt, int digits) {
+	NodeId id = allocateNode(stmt, sBIG);
+	ParseNode *node = NODE(stmt, id);
+
+	node->vType = tBIG;
+	node->value.big = bigFromString(stmt->names + digits);
+	addLiteral(stmt, (Element){ tBIG, node->value });
+
+	return id;
 }
 
-ParseNode *createVariable(char *name) {
-	ParseNode *stmt = allocateNode(0);
+NodeId createArray(Statement *stmt) {
+	NodeId id = allocateNode(stmt, sARRAY);
+	ParseNode *node = NODE(stmt, id);
+
+	node->vType = tSET;
+	node->value.array = newArray(eINT32, 0);
+	addLiteral(stmt, (Element){ tSET, node->value });
+
+	return id;
+}
+
+NodeId appendElement(Statement *stmt, NodeId array, NodeId number) {
+	ParseNode *node = NODE(stmt, number);
+	Element value;
+
+	value.type = node->vType;
+	value.value = node->value;
 
-	stmt->sType = sVAR;
-	stmt->name = strdup(name);
+	// the number's node is left behind, nothing refers to it
+	arrayAppend(NODE(stmt, array)->value.array, value);
+
+	return array;
+}
+
+NodeId createVariable(Statement *stmt, int name) {
+	NodeId id = allocateNode(stmt, sVAR);
+	ParseNode *node = NODE(stmt, id);
+
+	// the lexer already copied the identifier into the name pool
+	node->name = name;
 
 	// make no assumptions about vType or value
 
-	return stmt;
+	return id;
+}
+
+static int isInteger(ValueType type) {
+	return type == tINT || type == tBIG;
 }
 
-ParseNode *createArith(ArithOp op, ParseNode *left, ParseNode *right) {
-	ParseNode *stmt = allocateNode(2);
+NodeId createArith(Statement *stmt, ArithOp op, NodeId left, NodeId right) {
+	NodeId id = allocateNode(stmt, sARITH);
+	ParseNode *node = NODE(stmt, id);
 
-	stmt->sType = sARITH;
-	stmt->op.arithop = op;
+	node->op.arithop = op;
 
 	// real/int => real, int/int => int, int/real => real, real/real => real
 	// real*real => real, int*int => int, real*int => real
 	// real-real => real, real-int => real, int-int => int, int-real => real
 	// real+real => real, real+int => real, int+int => int
-	if (left->vType == tINT && right->vType == tINT) {
-		stmt->vType = tINT;
+	// and anything with an array => array, big integers count as ints
+	if (NODE(stmt, left)->vType == tSET || NODE(stmt, right)->vType == tSET) {
+		node->vType = tSET;
+	} else if (isInteger(NODE(stmt, left)->vType) && isInteger(NODE(stmt, right)->vType)) {
+		node->vType = tINT;
 	} else {
-		stmt->vType = tREAL;
+		node->vType = tREAL;
 	}
 
-	stmt->children[0] = left;
-	stmt->children[1] = right;
+	node->children[0] = left;
+	node->children[1] = right;
 
-	return stmt;
+	return id;
 }
 
-void deleteStatement(ParseNode *node) {
-	if (node == NULL)
-		return;
+NodeId createNil(Statement *stmt) {
+	NodeId id = allocateNode(stmt, sNIL);
+
+	NODE(stmt, id)->vType = tNIL;
+
+	return id;
+}
+
+NodeId createList(Statement *stmt, NodeId item, NodeId rest) {
+	NodeId id = allocateNode(stmt, sLIST);
+	ParseNode *node = NODE(stmt, id);
+
+	node->children[0] = item;
+	node->children[1] = rest;
+
+	return id;
+}
+
+// the number of items in a list
+static int listLength(Statement *stmt, NodeId list) {
+	int length = 0;
+
+	for (; NODE(stmt, list)->sType == sLIST; list = NODE(stmt, list)->children[1])
+		length++;
+
+	return length;
+}
+
+NodeId createDef(Statement *stmt, int name, NodeId params, NodeId body) {
+	NodeId id = allocateNode(stmt, sDEF);
+	ParseNode *node = NODE(stmt, id);
+
+	// a definition's value is nil, the parameter count rides along in its value
+	node->name = name;
+	node->vType = tNIL;
+	node->value.integer = listLength(stmt, params);
+
+	node->children[0] = params;
+	node->children[1] = body;
+
+	return id;
+}
 
-	int i = 0;
-	while (node->children != NULL && node->children[i] != NULL) {
-		deleteStatement(node->children[i]);
-		i++;
+NodeId createCall(Statement *stmt, int name, NodeId args) {
+	NodeId id = allocateNode(stmt, sCALL);
+	ParseNode *node = NODE(stmt, id);
+
+	// make no assumptions about vType, and keep the argument count in value
+	node->name = name;
+	node->value.integer = listLength(stmt, args);
+
+	node->children[0] = args;
+
+	return id;
+}
+
+NodeId createFor(Statement *stmt, NodeId var, NodeId from, NodeId to, NodeId body) {
+	NodeId id = allocateNode(stmt, sFOR);
+	ParseNode *node = NODE(stmt, id);
+
+	node->children[0] = var;
+	node->children[1] = from;
+	node->children[2] = to;
+	node->children[3] = body;
+
+	return id;
+}
+
+// trees up to this deep are walked without allocating
+#define SMALL_PATH 32
+
+typedef struct tagVisit {
+	NodeId id;
+	int visited;
+} Visit;
+
+int postorder(Statement *stmt, NodeId id, NodeId **order) {
+	// each node on the path down, and how many of its children have been visited
+	Visit small[SMALL_PATH], *path = small;
+	NodeId *out = NULL, child = NO_NODE;
+	int depth = 0, pathCapacity = SMALL_PATH, count = 0, outCapacity = 0;
+	ParseNode *node;
+
+	do {
+		if (depth == pathCapacity) {
+			pathCapacity *= 2;
+
+			if (path == small) {
+				path = (Visit *)malloc(pathCapacity * sizeof(Visit));
+				memcpy(path, small, sizeof small);
+			} else {
+				path = (Visit *)realloc(path, pathCapacity * sizeof(Visit));
+			}
+		}
+
+		path[depth].id = id;
+		path[depth++].visited = 0;
+
+		// go back up until some node has a child left, which is next
+		while (depth > 0) {
+			node = NODE(stmt, path[depth - 1].id);
+
+			if (path[depth - 1].visited < stmtArity[node->sType]) {
+				child = node->children[path[depth - 1].visited++];
+				break;
+			}
+
+			if (count == outCapacity) {
+				outCapacity = outCapacity ? outCapacity * 2 : 16;
+				out = (NodeId *)realloc(out, outCapacity * sizeof(NodeId));
+			}
+
+			out[count++] = path[--depth].id;
+		}
+
+		id = child;
+	} while (depth > 0);
+
+	if (path != small)
+		free(path);
+
+	*order = out;
+	return count;
+}
+
+NodeId copySubtree(Statement *to, Statement *from, NodeId id) {
+	ParseNode node;
+	Element literal;
+	NodeId *order, *copies;
+	int count = postorder(from, id, &order), top = 0, arity, i, j;
+
+	// children first, the same order the parser builds them in. Each one's copy waits on a
+	// stack for its parent, which can share the order's memory: it never grows past the
+	// node being copied.
+	copies = order;
+
+	for (i = 0; i < count; i++) {
+		node = *NODE(from, order[i]);
+		arity = stmtArity[node.sType];
+
+		for (j = 0; j < arity; j++)
+			node.children[j] = copies[top - arity + j];
+		top -= arity;
+
+		if (node.name >= 0)
+			node.name = internName(to, NAME(from, &node), strlen(NAME(from, &node)));
+
+		if (node.sType == sARRAY || node.sType == sBIG) {
+			literal = copyValue(NULL, (Element){ node.vType, node.value });
+			node.value = literal.value;
+			addLiteral(to, literal);
+		}
+
+		copies[top] = allocateNode(to, node.sType);
+		*NODE(to, copies[top++]) = node;
 	}
 
-	if (node->children != NULL)
-		free(node->children);
+	id = copies[0];
+
+	free(order);
+
+	return id;
+}
+
+void deleteStatement(Statement *stmt) {
+	if (stmt == NULL)
+		return;
 
-	free(node);
-	node = NULL;
+	// the whole tree lives in a few flat buffers
+	freeLiterals(stmt);
+	unmap(stmt);
+	free(stmt->nodes);
+	free(stmt->names);
+	free(stmt->roots);
+	free(stmt->literals);
+	free(stmt);
 }
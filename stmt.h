@@ -1,6 +1,9 @@
 #ifndef __STMT_H__
 #define __STMT_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 typedef enum tagBoolOp {
 	bLESSTHAN,
 	bGREATERTHAN,
@@ -19,28 +22,47 @@ typedef enum tagStmtType {
 	sIF,
 	sIFELSE,
 	sBOOL,
+	sBOOLVAL,
 	sINT,
 	sVAR,
-	sARITH
+	sARITH,
+	sNIL,
+	sREAL,
+	sARRAY,
+	sBIG,
+	sDEF,
+	sCALL,
+	sLIST,
+	sFOR,
+
+	// a variable in a function body that's one of its parameters (see function.h)
+	sPARAM
 } StmtType;
 
+// how many StmtTypes there are
+#define STMT_TYPES (sPARAM + 1)
+
 typedef enum tagValueType {
 	tNIL,
 	tBOOL,
 	tINT,
 	tREAL,
 	tSTR,
-	tSET
+	tSET,
+	tBIG
 } ValueType;
 
-// forward-declare tagElement to solve circular dependency
-struct tagElement;
+// arrays are defined in array.h, big integers in bigint.h
+struct tagArray;
+struct tagBigInt;
 
 typedef union tagValue {
-	int integer;
+	int64_t integer;
 	int boolean;
+	double real;
 	char *string;
-	struct tagElement **set;
+	struct tagArray *array;
+	struct tagBigInt *big;
 } Value;
 
 typedef struct tagElement {
@@ -48,49 +70,147 @@ typedef struct tagElement {
 	Value value;
 } Element;
 
+// elements are passed around by value, so nil needs no storage of its own
+#define NIL ((Element){ tNIL })
+
 typedef union tagOp {
 	ArithOp arithop;
 	BoolOp boolop;
 } Op;
 
+// nodes refer to each other by their index in the statement's node array
+typedef int NodeId;
+
+#define NO_NODE (-1)
+
+// no statement type has more children than this
+#define MAX_CHILDREN 4
+
+// number of children used by each StmtType
+extern const int stmtArity[];
+
 // TODO: not everything has a name or an operation
 typedef struct tagParseNode {
 	StmtType sType;
 	Op op;
 
-	char *name;
+	// offset of the identifier in the statement's name pool
+	int name;
+
+	// where the variable lives in the State (filled in by resolveStatement()), which function
+	// a call is to, or which parameter
+	int slot;
 
 	// all statements have a value - gets propagated up tree from leaves when evaluating
 	ValueType vType;
 	Value value;
 
-	// tree isn't necessarily binary
-	struct tagParseNode **children;
+	// only the first stmtArity[sType] entries are used
+	NodeId children[MAX_CHILDREN];
 } ParseNode;
 
+// A parsed statement: all of its nodes and identifiers live in two flat buffers,
+// so it can be thrown away (or reused for the next parse) in one go
+typedef struct tagStatement {
+	ParseNode *nodes;
+	int count;
+	int capacity;
+
+	// NUL-terminated identifiers, referenced by offset
+	char *names;
+	int namesLength;
+	int namesCapacity;
+
+	// top-level statements, in source order
+	NodeId *roots;
+	int rootCount;
+	int rootCapacity;
+
+	// array and big integer literals, owned by the statement (evaluating one copies it)
+	Element *literals;
+	int literalCount;
+	int literalCapacity;
+
+	// why the last parse failed and on which line, for the caller to report
+	const char *syntaxError;
+	int errorLine;
+
+	// a precompiled file (see terpc.h) that nodes, names and roots point into instead of
+	// their own buffers, NULL if they're ordinary allocations
+	void *mapping;
+	size_t mappingSize;
+} Statement;
+
+#define NODE(stmt, id) (&(stmt)->nodes[(id)])
+#define NAME(stmt, node) ((stmt)->names + (node)->name)
+
+// Create an empty statement arena
+Statement *newStatement();
+
+// Forget every node in the statement, keeping its buffers for the next parse
+void resetStatement(Statement *stmt);
+
+// Append a top-level statement
+void addRoot(Statement *stmt, NodeId root);
+
+// Hand an array or big integer literal's memory to the statement
+void addLiteral(Statement *stmt, Element literal);
+
+// Copy an identifier into the statement's name pool, returns its offset
+int internName(Statement *stmt, const char *name, int length);
+
 // Create an assignment (this and all below will be added to the parse tree in the parser)
-ParseNode *createAssign(ParseNode *var, ParseNode *val);
+NodeId createAssign(Statement *stmt, NodeId var, NodeId val);
 
 // Create an if statement
-ParseNode *createIf(ParseNode *cond, ParseNode *true);
+NodeId createIf(Statement *stmt, NodeId cond, NodeId true);
 
 // Create an if/else statement
-ParseNode *createIfElse(ParseNode *cond, ParseNode *true, ParseNode *false);
+NodeId createIfElse(Statement *stmt, NodeId cond, NodeId true, NodeId false);
 
 // Create a boolean statement
-ParseNode *createBool(BoolOp op, ParseNode *left, ParseNode *right);
-ParseNode *createBoolTerminal(int value);
+NodeId createBool(Statement *stmt, BoolOp op, NodeId left, NodeId right);
+NodeId createBoolTerminal(Statement *stmt, int value);
 
 // Create an integer value
-ParseNode *createInt(int value);
+NodeId createInt(Statement *stmt, int64_t value);
+
+// Create an integer literal too big for 64 bits (digits is an offset returned by internName)
+NodeId createBig(Statement *stmt, int digits);
+
+// Create a real value
+NodeId createReal(Statement *stmt, double value);
 
-// Create a variable
-ParseNode *createVariable(char *name);
+// Create an empty array literal, and add a number (an sINT or sREAL node) to the end of one
+NodeId createArray(Statement *stmt);
+NodeId appendElement(Statement *stmt, NodeId array, NodeId number);
+
+// Create a variable (name is an offset returned by internName)
+NodeId createVariable(Statement *stmt, int name);
 
 // Create an arithmetic expression
-ParseNode *createArith(ArithOp op, ParseNode *left, ParseNode *right);
+NodeId createArith(Statement *stmt, ArithOp op, NodeId left, NodeId right);
+
+// Create the nil that ends a list (and is all an empty one is), and put an item in front of a list
+NodeId createNil(Statement *stmt);
+NodeId createList(Statement *stmt, NodeId item, NodeId rest);
+
+// Create a function definition (params is a list of variables) and a call (args is a list of
+// expressions). name is an offset returned by internName.
+NodeId createDef(Statement *stmt, int name, NodeId params, NodeId body);
+NodeId createCall(Statement *stmt, int name, NodeId args);
+
+// Create a loop running body once for each integer from from to to, inclusive, with var set to it
+NodeId createFor(Statement *stmt, NodeId var, NodeId from, NodeId to, NodeId body);
+
+// The tree under id, children before their parents and left to right (the order its values
+// are computed in), found without recursing however deep it goes. Returns how many nodes,
+// the caller frees *order.
+int postorder(Statement *stmt, NodeId id, NodeId **order);
+
+// Copy the tree under id in from into to (names and literals included), returns the copy's root
+NodeId copySubtree(Statement *to, Statement *from, NodeId id);
 
 // Delete a statement (free from memory)
-void deleteStatement(ParseNode *node);
+void deleteStatement(Statement *stmt);
 #endif
-
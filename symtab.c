@@ -0,0 +1,238 @@
+#include "symtab.h"
+#include "stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CTRL_EMPTY ((int8_t)-128)
+#define CTRL_DELETED ((int8_t)-2)
+
+// grow once the table is 7/8 full
+#define MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+static void initTable(SymbolTable *table, uint32_t capacity) {
+	table->capacity = capacity;
+	table->size = 0;
+	table->deleted = 0;
+
+	// groups are loaded with aligned SSE2 loads
+	table->ctrl = (int8_t *)aligned_alloc(GROUP_WIDTH, capacity);
+	memset(table->ctrl, CTRL_EMPTY, capacity);
+
+	table->symbols = (Symbol *)malloc(capacity * sizeof(Symbol));
+}
+
+SymbolTable *newSymbolTable() {
+	SymbolTable *table = (SymbolTable *)malloc(sizeof(SymbolTable));
+	initTable(table, GROUP_WIDTH);
+
+	return table;
+}
+
+void freeSymbolTable(SymbolTable *table) {
+	int i;
+
+	for (i = symbolNext(table, -1); i >= 0; i = symbolNext(table, i))
+		free(table->symbols[i].key);
+
+	free(table->ctrl);
+	free(table->symbols);
+	free(table);
+}
+
+uint32_t symbolHash(const char *key, uint32_t length) {
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ length, word;
+
+	// a word at a time, then whatever is left over
+	while (length >= 8) {
+		memcpy(&word, key, 8);
+		h = (h ^ word) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+		key += 8;
+		length -= 8;
+	}
+
+	if (length > 0) {
+		word = 0;
+		memcpy(&word, key, length);
+		h = (h ^ word) * 0xff51afd7ed558ccdULL;
+	}
+
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 29;
+
+	return (uint32_t)h;
+}
+
+// bit i is set if control byte i of the group matches
+static uint32_t matchByte(const int8_t *group, int8_t byte) {
+#ifdef __SSE2__
+	__m128i ctrl = _mm_load_si128((const __m128i *)group);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(byte)));
+#else
+	uint32_t mask = 0;
+	int i;
+
+	for (i = 0; i < GROUP_WIDTH; i++)
+		if (group[i] == byte)
+			mask |= 1u << i;
+
+	return mask;
+#endif
+}
+
+static int sameKey(const Symbol *symbol, uint32_t hash, uint32_t length, const char *prefix, const char *key) {
+	if (symbol->hash != hash || symbol->length != length)
+		return 0;
+
+	if (memcmp(symbol->prefix, prefix, PREFIX_LENGTH) != 0)
+		return 0;
+
+	// short keys are entirely in the prefix
+	return length <= PREFIX_LENGTH || memcmp(symbol->key + PREFIX_LENGTH, key + PREFIX_LENGTH, length - PREFIX_LENGTH) == 0;
+}
+
+// Probe for a key. Returns its bucket, or -1 with *empty set to the first reusable bucket on its probe path.
+static int probe(SymbolTable *table, const char *key, uint32_t length, uint32_t hash, int *empty) {
+	uint32_t groups = table->capacity / GROUP_WIDTH;
+	uint32_t group = (hash >> 7) & (groups - 1);
+	int8_t h2 = (int8_t)(hash & 0x7f);
+	char prefix[PREFIX_LENGTH] = { 0 };
+	uint32_t mask, step, bucket;
+
+	memcpy(prefix, key, length < PREFIX_LENGTH ? length : PREFIX_LENGTH);
+	*empty = -1;
+
+	STAT_INC(lookups);
+
+	// triangular probing over groups visits every group when the count is a power of two
+	for (step = 1; ; step++) {
+		const int8_t *ctrl = table->ctrl + group * GROUP_WIDTH;
+
+		STAT_INC(probedGroups);
+
+		for (mask = matchByte(ctrl, h2); mask != 0; mask &= mask - 1) {
+			bucket = group * GROUP_WIDTH + __builtin_ctz(mask);
+
+			if (sameKey(&table->symbols[bucket], hash, length, prefix, key))
+				return bucket;
+		}
+
+		// removed keys leave a tombstone that can be reused but doesn't end the search
+		mask = matchByte(ctrl, CTRL_DELETED);
+		if (mask != 0 && *empty < 0)
+			*empty = group * GROUP_WIDTH + __builtin_ctz(mask);
+
+		mask = matchByte(ctrl, CTRL_EMPTY);
+		if (mask != 0) {
+			if (*empty < 0)
+				*empty = group * GROUP_WIDTH + __builtin_ctz(mask);
+			return -1;
+		}
+
+		group = (group + step) & (groups - 1);
+	}
+}
+
+static void place(SymbolTable *table, Symbol *symbol) {
+	int bucket;
+
+	probe(table, symbol->key, symbol->length, symbol->hash, &bucket);
+
+	table->ctrl[bucket] = (int8_t)(symbol->hash & 0x7f);
+	table->symbols[bucket] = *symbol;
+	table->size++;
+}
+
+static void rehash(SymbolTable *table, uint32_t capacity) {
+	SymbolTable old = *table;
+	int i;
+
+	initTable(table, capacity);
+	STAT_INC(resizes);
+
+	// keys move with their symbols, nothing is reallocated but the buckets
+	for (i = symbolNext(&old, -1); i >= 0; i = symbolNext(&old, i))
+		place(table, &old.symbols[i]);
+
+	free(old.ctrl);
+	free(old.symbols);
+}
+
+int *symbolLookup(SymbolTable *table, const char *key) {
+	uint32_t length = strlen(key);
+	int empty, bucket;
+
+	bucket = probe(table, key, length, symbolHash(key, length), &empty);
+
+	return bucket < 0 ? NULL : &table->symbols[bucket].value;
+}
+
+int *symbolInsert(SymbolTable *table, const char *key, int *created) {
+	uint32_t length = strlen(key);
+	uint32_t hash = symbolHash(key, length);
+	Symbol symbol;
+	int empty, bucket;
+
+	*created = 0;
+
+	bucket = probe(table, key, length, hash, &empty);
+	if (bucket >= 0)
+		return &table->symbols[bucket].value;
+
+	// tombstones count against the load factor until a rehash clears them out
+	if (table->size + table->deleted + 1 > MAX_LOAD(table->capacity)) {
+		rehash(table, table->size + 1 > MAX_LOAD(table->capacity) / 2 ? table->capacity * 2 : table->capacity);
+		probe(table, key, length, hash, &empty);
+	}
+
+	symbol.hash = hash;
+	symbol.length = length;
+	memset(symbol.prefix, 0, PREFIX_LENGTH);
+	memcpy(symbol.prefix, key, length < PREFIX_LENGTH ? length : PREFIX_LENGTH);
+	symbol.key = strdup(key);
+	symbol.value = 0;
+
+	if (table->ctrl[empty] == CTRL_DELETED)
+		table->deleted--;
+
+	table->ctrl[empty] = (int8_t)(hash & 0x7f);
+	table->symbols[empty] = symbol;
+	table->size++;
+
+	*created = 1;
+	return &table->symbols[empty].value;
+}
+
+int symbolRemove(SymbolTable *table, const char *key) {
+	uint32_t length = strlen(key);
+	int empty, bucket;
+
+	bucket = probe(table, key, length, symbolHash(key, length), &empty);
+	if (bucket < 0)
+		return 0;
+
+	free(table->symbols[bucket].key);
+
+	table->ctrl[bucket] = CTRL_DELETED;
+	table->size--;
+	table->deleted++;
+
+	return 1;
+}
+
+int symbolNext(SymbolTable *table, int index) {
+	uint32_t i;
+
+	// only buckets whose control byte holds a hash are live (EMPTY and DELETED are negative)
+	for (i = index + 1; i < table->capacity; i++)
+		if (table->ctrl[i] >= 0)
+			return i;
+
+	return -1;
+}
@@ -0,0 +1,62 @@
+#ifndef __SYMTAB_H__
+#define __SYMTAB_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// control bytes are scanned a group at a time (one SSE2 register)
+#define GROUP_WIDTH 16
+
+// bytes of each key kept inline next to its hash
+#define PREFIX_LENGTH 8
+
+typedef struct tagSymbol {
+	uint32_t hash;
+	uint32_t length;
+
+	// first PREFIX_LENGTH bytes of the key, zero padded
+	char prefix[PREFIX_LENGTH];
+
+	// owned by the table
+	char *key;
+
+	int value;
+} Symbol;
+
+// symbols hold their value inline, so a value pointer leads back to its symbol (and key)
+#define SYMBOL_OF(pointer) ((Symbol *)((char *)(pointer) - offsetof(Symbol, value)))
+
+// Open-addressing string -> int map. Each bucket has a control byte that is either
+// EMPTY, DELETED or the low 7 bits of its key's hash; a whole group of control bytes is
+// compared against a hash at once, and hash/length/prefix are checked before
+// a key string is ever touched.
+typedef struct tagSymbolTable {
+	int8_t *ctrl;
+	Symbol *symbols;
+
+	// always a power of two (and a multiple of GROUP_WIDTH)
+	uint32_t capacity;
+	uint32_t size;
+
+	// buckets holding a tombstone left by symbolRemove()
+	uint32_t deleted;
+} SymbolTable;
+
+SymbolTable *newSymbolTable();
+void freeSymbolTable(SymbolTable *table);
+
+uint32_t symbolHash(const char *key, uint32_t length);
+
+// Find a key, returns a pointer to its value or NULL if it isn't in the table
+int *symbolLookup(SymbolTable *table, const char *key);
+
+// Find a key, adding it (with value 0) if it's missing. *created is set to 1 if it was added.
+int *symbolInsert(SymbolTable *table, const char *key, int *created);
+
+// Remove a key, returns 0 if it wasn't in the table
+int symbolRemove(SymbolTable *table, const char *key);
+
+// Iterate over live symbols: for (i = symbolNext(t, -1); i >= 0; i = symbolNext(t, i))
+int symbolNext(SymbolTable *table, int index);
+
+#endif
@@ -1,9 +1,18 @@
 #include "stmt.h"
-#include "khash.h"
 #include "eval.h"
 #include "terp.h"
+#include "script.h"
+#include "cache.h"
+#include "value.h"
+#include "stats.h"
+#include "batch.h"
+#include "image.h"
+#include "server.h"
+#include "function.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // for history functionality
 #include <readline/readline.h>
@@ -12,56 +21,32 @@
 // TODO: make global history in user's home directory
 const char *HISTORY_FILENAME = ".terp_history";
 
-void error(char *msg) {
-	printf("%s\n", msg);
-}
-
 void hello(void) {
 	printf("terp (v2.awesome - compiled with --<3-bugs option)\n\n");
 	printf("Enter 'quit' to confirm your status as a quitter. Enter code to get yelled at by a computer.\n");
 }
 
 void print(Element *result) {
-	switch(result->type) {
-	case tNIL:
-		printf(": nil\n");
-		break;
-	case tINT:
-		printf(": %d\n", result->value.integer);
-		break;
-	case tSTR:
-		printf(": %s\n", result->value.string);
-		break;
-	case tBOOL:
-		printf(": %s\n", (result->value.boolean) ? "true" : "false");
-		break;
-	default:
-		printf(": Error, could not identify return type\n");
-		break;
-	}
+	printf(": ");
+	printValue(stdout, *result);
+	printf("\n");
 }
 
-State *initState() {
-	State *ret = (State *)malloc(sizeof(State *));
-	ret->h = kh_init(32);
+void printCacheStats(State *state) {
+	StatementCache *cache = state->cache;
 
-	return ret;
-}
+	if (cache == NULL) {
+		printf("statement cache disabled\n");
+		return;
+	}
 
-// convenience function for hashmap "exists"
-int exists(kh_32_t *h, char *key) {
-	khiter_t k = kh_get(32, h, key);
-	return !(k == kh_end(h));
+	printf("statement cache: %d/%d entries, %lu hits, %lu misses, %lu evictions\n",
+		cache->count, cache->capacity, cache->hits, cache->misses, cache->evictions);
 }
 
-void freeState(State *state) {
-	int i;
-	// start at i=1, because that's the first value in khash's implementation
-	for (i = 1; i <= kh_size(state->h); i++)
-		free(state->h->vals[i]);
-
-	kh_destroy(32, state->h);
-	free(state);
+void printHeapStats(State *state) {
+	printf("heap: %d arrays and big integers in %zu bytes (peak %zu), next collection at %d or %zu bytes\n",
+		state->heapCount, state->heapBytes, state->heapPeak, state->heapLimit, state->heapByteLimit);
 }
 
 void setupHistory() {
@@ -76,43 +61,103 @@ void setupHistory() {
 	read_history_range(HISTORY_FILENAME, 0, 15);
 }
 
-void interpretScript(char *file, State *state) {
-	/* Open the script file specified on the command line */
-	FILE *script = fopen(file, "r");
+int main(int argc, char *argv[]) {
+	Element result;
+	char *input, *script = NULL, *saveTo = NULL, *socket = NULL;
+	char **scripts = NULL;
+	int i, size, stats = 0, batch = 0, jobs = 0, shared = 0, scriptCount = 0, status;
 
-	char *line;
-	size_t len = 0;
-	Element *result;
+	/* Interpreter session state */
+	State *state = initState();
 
-	if (script) {
-		while (getline(&line, &len, script) != -1) {
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--tree") == 0) {
+			state->treeWalk = 1;
+		} else if (strcmp(argv[i], "--no-jit") == 0) {
+			state->jit = 0;
+		} else if (strcmp(argv[i], "--reactive") == 0) {
+			// `name = expression` keeps name up to date as the variables it reads change
+			state->reactive = 1;
+		} else if (strcmp(argv[i], "--no-terpc") == 0) {
+			// always parse scripts, and don't leave .terpc files behind
+			state->precompiled = 0;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			// dump the instrumentation counters on the way out
+			stats = 1;
+		} else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+			// number of parsed lines to keep around, 0 turns the cache off
+			freeCache(state->cache);
+			size = atoi(argv[++i]);
+			state->cache = size > 0 ? newCache(size) : NULL;
+		} else if (strcmp(argv[i], "--batch") == 0) {
+			// every other argument is a script (or directory of them) to run in parallel
+			batch = 1;
+		} else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+			// threads for --batch, one per core by default
+			jobs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+			// answer statements sent to a Unix domain socket, any scripts are run first
+			socket = argv[++i];
+		} else if (strcmp(argv[i], "--shared") == 0) {
+			// --serve with one session for every client instead of one each
+			shared = 1;
+		} else if (strcmp(argv[i], "--load-image") == 0 && i + 1 < argc) {
+			// start from the variables saved in an image instead of running a prelude
+			closeImage(state->image);
+			if ((state->image = openImage(state, argv[++i])) == NULL)
+				return -1;
+		} else if (strcmp(argv[i], "--save-image") == 0 && i + 1 < argc) {
+			// write the variables out when the script (or session) is done
+			saveTo = argv[++i];
+		} else {
+			script = argv[i];
+
+			scripts = realloc(scripts, (scriptCount + 1) * sizeof(char *));
+			scripts[scriptCount++] = argv[i];
+		}
+	}
 
-			/* Don't care about the return value of each statement, the script will handle its own output.
-			Still take return value so that it can be freed. */
-			result = evaluateLine(line, state);
-			free(result);
+	if (batch) {
+		status = runBatch(scripts, scriptCount, jobs, state, stdout) > 0;
 
-			free(line);
-			line = NULL;
-		}
-	} else {
-		error("Could not open script!");
-		exit(-1);
+		if (stats)
+			printStats(stderr);
+
+		free(scripts);
+		closeImage(state->image);
+		freeState(state);
+		return status;
 	}
-}
 
-int main(int argc, char *argv[]) {
-	Element *result = NULL;
-	char *input;
+	if (socket != NULL) {
+		// sessions start from whatever the scripts leave behind
+		for (i = 0, status = 0; i < scriptCount && !status; i++)
+			status = !interpretScript(scripts[i], state) || state->errors > 0;
 
-	/* Interpreter session state */
-	State *state = initState();
+		if (!status)
+			status = !serve(socket, state, shared);
 
-	if (argc > 1) {
-		/* For now, accept no command line arguments apart from script interpreter functionality */
+		if (stats)
+			printStats(stderr);
 
-		interpretScript(argv[1], state);
-		return 0;
+		free(scripts);
+		closeImage(state->image);
+		freeState(state);
+		return status;
+	}
+
+	free(scripts);
+
+	if (script != NULL) {
+		status = !interpretScript(script, state);
+
+		if (saveTo != NULL && !saveImage(state, saveTo))
+			status = 1;
+
+		if (stats)
+			printStats(stderr);
+
+		return status ? -1 : 0;
 	}
 
 	setupHistory();
@@ -121,25 +166,49 @@ int main(int argc, char *argv[]) {
 	while (1) {
 		input = readline("> ");
 
-		if (strcmp(input, "quit") == 0)
+		if (input == NULL || strcmp(input, "quit") == 0)
 			break;
 
-		add_history(input);
+		if (strcmp(input, ":cache") == 0) {
+			printCacheStats(state);
+			free(input);
+			continue;
+		}
 
-		result = evaluateLine(input, state);
-		print(result);
+		if (strcmp(input, ":heap") == 0) {
+			printHeapStats(state);
+			free(input);
+			continue;
+		}
+
+		if (strcmp(input, ":functions") == 0) {
+			printFunctionStats(stdout, state);
+			free(input);
+			continue;
+		}
+
+		if (strcmp(input, ":stats") == 0) {
+			printStats(stdout);
+			free(input);
+			continue;
+		}
 
-		// cleanup
+		add_history(input);
 
-		// make sure to not free the singleton
-		if (result->type != tNIL)
-			free(result);
+		if (evaluateLine(input, state, &result))
+			print(&result);
 
 		free(input);
 	}
 
 	write_history(HISTORY_FILENAME);
 
-	freeNil();
+	if (saveTo != NULL)
+		saveImage(state, saveTo);
+
+	if (stats)
+		printStats(stderr);
+
+	closeImage(state->image);
 	freeState(state);
 }
@@ -1,13 +1,124 @@
 #ifndef __TERP_H__
 #define __TERP_H__
 
-#include "khash.h"
+#include "stmt.h"
+#include "symtab.h"
 
-// setup hashmap
-KHASH_MAP_INIT_STR(32, Element *)
+#include <stdio.h>
+
+struct tagStatementCache;
+struct tagImage;
+struct tagCell;
+struct tagUserFunction;
+
+typedef struct tagSlot {
+	Element value;
+
+	// slots are handed out the first time a name is seen, but only hold a value once assigned
+	int defined;
+
+	// in reactive mode, the variable's definition and the ones that read it (see reactive.h)
+	struct tagCell *cell;
+} Slot;
 
 typedef struct tagState {
-	khash_t(32) *h;
+	// variable name -> slot index
+	SymbolTable *symbols;
+
+	// variable values, indexed by the slots resolveStatement() stores in the tree
+	Slot *slots;
+	int slotCount;
+	int slotCapacity;
+
+	// function name -> index into functions (see function.h)
+	SymbolTable *functionNames;
+	struct tagUserFunction *functions;
+	int functionCount;
+	int functionCapacity;
+
+	// the arguments of the call being evaluated (NULL outside of one), how many there are, and
+	// how deep it is
+	Element *frame;
+	int frameSize;
+	int callDepth;
+
+	// arena that evaluateLine() parses each line into
+	Statement *scratch;
+
+	// recently evaluated lines, already parsed and resolved (NULL if disabled)
+	struct tagStatementCache *cache;
+
+	// evaluate with the recursive tree-walker instead of the bytecode VM
+	int treeWalk;
+
+	// compile hot cached statements to native code
+	int jit;
+
+	// treat `name = expression` as a definition that's kept up to date (see reactive.h)
+	int reactive;
+
+	// load scripts from (and save them to) .terpc files instead of parsing every time
+	int precompiled;
+
+	// every array and big integer made so far that collectGarbage() hasn't freed
+	Element *heap;
+	int heapCount;
+	int heapCapacity;
+
+	// what they take up, and the most they ever have
+	size_t heapBytes;
+	size_t heapPeak;
+
+	// collect once there are this many, or once they take up this much
+	int heapLimit;
+	size_t heapByteLimit;
+
+	// where error messages go (NULL drops them), how many there have been, and the last one
+	FILE *out;
+	int errors;
+	char lastError[128];
+
+	// image the session started from (see image.h), variables are copied out of it the first
+	// time they're seen. Not owned, several States can share one.
+	struct tagImage *image;
 } State;
 
+// Values are dropped once no variable holds them, but not before the State has this many (or
+// they take up this many bytes)
+#define HEAP_COLLECT_MIN 64
+#define HEAP_COLLECT_BYTES (1 << 20)
+
+// whether a state has made enough values since it last collected to be worth collecting again
+#define COLLECTION_DUE(state) ((state)->heapCount >= (state)->heapLimit || (state)->heapBytes >= (state)->heapByteLimit)
+
+// Report an error in state (with no state, there's nobody to tell)
+void error(State *state, char *msg);
+
+// Create a session with no variables and the default statement cache
+State *initState();
+
+// Create a session with another one's settings (evaluator, JIT, reactive, .terpc, cache size)
+// and image, but none of its variables
+State *initStateLike(State *like);
+void freeState(State *state);
+
+int exists(State *state, char *name);
+
+// Find the slot holding a variable, creating an undefined one on first sight
+int lookupSlot(State *state, const char *name);
+
+// Hand a new array or big integer to state, which owns it from then on (with no state,
+// the caller keeps it)
+Element keepValue(State *state, Element value);
+
+// Free the values state made that no variable refers to any more. Called between top-level
+// statements, when the only values still around are the variables'.
+void collectGarbage(State *state);
+
+// Free the values allocated after heap position since that no variable, argument of the
+// current call, or keep refers to. Called between a loop's iterations: everything older may
+// still be in use by the statement the loop is part of, but what an iteration made and didn't
+// store is done with. Only worth calling when COLLECTION_DUE().
+void collectLoopGarbage(State *state, int since, Element keep);
+
 #endif
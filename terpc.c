@@ -0,0 +1,359 @@
+#include "terpc.h"
+#include "stmt.h"
+#include "array.h"
+#include "bigint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define TERPC_BYTE_ORDER 0x01020304
+
+#define ALIGN(n) (((n) + 7) & ~(uint64_t)7)
+
+uint64_t sourceHash(const char *source, size_t size) {
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ size, word;
+
+	// the same mixing as symbolHash(), keeping all 64 bits
+	while (size >= 8) {
+		memcpy(&word, source, 8);
+		h = (h ^ word) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+		source += 8;
+		size -= 8;
+	}
+
+	if (size > 0) {
+		word = 0;
+		memcpy(&word, source, size);
+		h = (h ^ word) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+
+	return h;
+}
+
+// where the .terpc for a script goes, the caller frees it
+static char *precompiledPath(const char *file, uint64_t hash) {
+	const char *dir = getenv("TERP_CACHE_DIR");
+	size_t length = strlen(file);
+	char *path;
+
+	if (dir != NULL && *dir != '\0') {
+		path = malloc(strlen(dir) + 24);
+		sprintf(path, "%s/%016llx.terpc", dir, (unsigned long long)hash);
+	} else if (length > 5 && strcmp(file + length - 5, ".terp") == 0) {
+		path = malloc(length + 2);
+		sprintf(path, "%sc", file);
+	} else {
+		path = malloc(length + 7);
+		sprintf(path, "%s.terpc", file);
+	}
+
+	return path;
+}
+
+// a literal's elements or limbs, and how many bytes of them there are
+static const void *literalData(ParseNode *node, size_t *size) {
+	if (node->sType == sARRAY) {
+		*size = dataSize(node->value.array->type, node->value.array->length);
+		return node->value.array->data;
+	}
+
+	*size = node->value.big->length * sizeof(uint32_t);
+	return node->value.big->limbs;
+}
+
+// write n bytes at the next multiple of 8 after *at, returns where they went
+static uint64_t put(FILE *out, uint64_t *at, const void *bytes, size_t n) {
+	static const char zeros[8];
+	uint64_t offset = ALIGN(*at);
+
+	fwrite(zeros, 1, offset - *at, out);
+	fwrite(bytes, 1, n, out);
+
+	*at = offset + n;
+	return offset;
+}
+
+void savePrecompiled(const char *file, uint64_t hash, size_t size, Statement *stmt) {
+	TerpcHeader header = { TERPC_MAGIC, TERPC_VERSION, TERPC_BYTE_ORDER, sizeof(ParseNode), STMT_TYPES };
+	TerpcLiteral literal;
+	ParseNode *node;
+	const void *data;
+	char *path, *temp, *buffer;
+	size_t dataBytes, length;
+	uint64_t at = 0;
+	FILE *out;
+	int i, fd, ok;
+
+	// built in memory, so the checksum can go in the header before anything hits the disk
+	if ((out = open_memstream(&buffer, &length)) == NULL)
+		return;
+
+	header.sourceHash = hash;
+	header.sourceSize = size;
+	header.count = stmt->count;
+	header.rootCount = stmt->rootCount;
+	header.namesLength = stmt->namesLength;
+
+	// the header is filled in at the end, once the offsets are known
+	put(out, &at, &header, sizeof header);
+	header.nodes = put(out, &at, stmt->nodes, stmt->count * sizeof(ParseNode));
+	header.roots = put(out, &at, stmt->roots, stmt->rootCount * sizeof(NodeId));
+	header.names = put(out, &at, stmt->names, stmt->namesLength);
+	// padded out even if no literals follow, so the offset is always inside the file
+	header.literals = put(out, &at, &literal, 0);
+
+	// one per node, folding can leave two nodes sharing a literal
+	for (i = 0; i < stmt->count; i++) {
+		node = NODE(stmt, i);
+
+		if (node->sType != sARRAY && node->sType != sBIG)
+			continue;
+
+		data = literalData(node, &dataBytes);
+
+		literal.node = i;
+		literal.type = node->vType;
+		literal.kind = node->sType == sARRAY ? node->value.array->type : node->value.big->negative;
+		literal.length = node->sType == sARRAY ? node->value.array->length : node->value.big->length;
+
+		put(out, &at, &literal, sizeof literal);
+		put(out, &at, data, dataBytes);
+		header.literalCount++;
+	}
+
+	fclose(out);
+
+	header.size = length;
+	header.checksum = sourceHash(buffer + sizeof header, length - sizeof header);
+	memcpy(buffer, &header, sizeof header);
+
+	path = precompiledPath(file, hash);
+	temp = malloc(strlen(path) + 8);
+	sprintf(temp, "%s.XXXXXX", path);
+
+	// a unique temporary name, --batch may be writing the same script's from several threads
+	if ((fd = mkstemp(temp)) >= 0) {
+		ok = write(fd, buffer, length) == (ssize_t)length;
+		ok = close(fd) == 0 && ok;
+
+		// renamed into place whole, so a reader never sees half a file
+		if (!ok || rename(temp, path) != 0)
+			unlink(temp);
+	}
+
+	free(temp);
+	free(path);
+	free(buffer);
+}
+
+// how many items the (already checked) list at id has, -1 if it isn't a list ending in nil
+static int listLength(const ParseNode *nodes, NodeId id) {
+	int length = 0;
+
+	for (; nodes[id].sType == sLIST; id = nodes[id].children[1])
+		length++;
+
+	return nodes[id].sType == sNIL ? length : -1;
+}
+
+// where a list can go: as a call's arguments, a definition's parameters or the rest of a list
+static int listAllowed(const ParseNode *node, int child) {
+	return child == (node->sType == sLIST ? 1 : 0) && (node->sType == sLIST || node->sType == sCALL || node->sType == sDEF);
+}
+
+// everything a Statement built from the file could trip over: sections out of bounds, child
+// links that aren't to earlier nodes (evaluation recurses over them), names outside the pool,
+// argument counts that aren't what the lists hold, assignments and loops to something other
+// than a variable. Parameters only come from resolving a definition, never from parsing one.
+static int valid(const char *data, size_t fileSize, uint64_t hash, size_t size) {
+	const TerpcHeader *header = (const TerpcHeader *)data;
+	const ParseNode *nodes;
+	const NodeId *roots;
+	NodeId id;
+	uint32_t i;
+	int j;
+
+	if (memcmp(header->magic, TERPC_MAGIC, sizeof TERPC_MAGIC) != 0 || header->version != TERPC_VERSION
+		|| header->byteOrder != TERPC_BYTE_ORDER || header->nodeSize != sizeof(ParseNode)
+		|| header->stmtTypes != STMT_TYPES || header->size != fileSize)
+		return 0;
+
+	// a different script now
+	if (header->sourceHash != hash || header->sourceSize != size)
+		return 0;
+
+	if (sourceHash(data + sizeof *header, fileSize - sizeof *header) != header->checksum)
+		return 0;
+
+	if (header->nodes + (uint64_t)header->count * sizeof(ParseNode) > fileSize
+		|| header->roots + (uint64_t)header->rootCount * sizeof(NodeId) > fileSize
+		|| header->names + header->namesLength > fileSize || header->literals > fileSize
+		|| header->nodes % 8 != 0 || header->roots % 8 != 0 || header->literals % 8 != 0)
+		return 0;
+
+	if (header->namesLength > 0 && data[header->names + header->namesLength - 1] != '\0')
+		return 0;
+
+	nodes = (const ParseNode *)(data + header->nodes);
+	roots = (const NodeId *)(data + header->roots);
+
+	for (i = 0; i < header->count; i++) {
+		if ((unsigned)nodes[i].sType >= STMT_TYPES || nodes[i].sType == sPARAM)
+			return 0;
+
+		for (j = 0; j < stmtArity[nodes[i].sType]; j++) {
+			if (nodes[i].children[j] < 0 || (uint32_t)nodes[i].children[j] >= i)
+				return 0;
+
+			if (nodes[nodes[i].children[j]].sType == sLIST && !listAllowed(&nodes[i], j))
+				return 0;
+		}
+
+		if ((nodes[i].sType == sVAR || nodes[i].sType == sCALL || nodes[i].sType == sDEF)
+			&& (nodes[i].name < 0 || (uint32_t)nodes[i].name >= header->namesLength))
+			return 0;
+
+		if ((nodes[i].sType == sCALL || nodes[i].sType == sDEF)
+			&& listLength(nodes, nodes[i].children[0]) != nodes[i].value.integer)
+			return 0;
+
+		if ((nodes[i].sType == sASSIGN || nodes[i].sType == sFOR) && nodes[nodes[i].children[0]].sType != sVAR)
+			return 0;
+
+		if (nodes[i].sType == sDEF) {
+			for (id = nodes[i].children[0]; nodes[id].sType == sLIST; id = nodes[id].children[1]) {
+				if (nodes[nodes[id].children[0]].sType != sVAR)
+					return 0;
+			}
+		}
+	}
+
+	for (i = 0; i < header->rootCount; i++) {
+		if (roots[i] < 0 || (uint32_t)roots[i] >= header->count || nodes[roots[i]].sType == sLIST)
+			return 0;
+	}
+
+	return 1;
+}
+
+// rebuild the array and big integer literals, 0 if they don't match up with the nodes
+static int loadLiterals(Statement *stmt, const char *data, const TerpcHeader *header) {
+	const TerpcLiteral *literal;
+	uint64_t at = header->literals;
+	ParseNode *node;
+	Element value;
+	size_t size;
+	uint32_t i;
+	int needed = 0;
+
+	// every literal node gets exactly one
+	for (i = 0; i < header->count; i++) {
+		node = NODE(stmt, i);
+
+		if (node->sType == sARRAY || node->sType == sBIG) {
+			node->value.array = NULL;
+			needed++;
+		}
+	}
+
+	if (needed != (int)header->literalCount)
+		return 0;
+
+	for (i = 0; i < header->literalCount; i++) {
+		if (at + sizeof(TerpcLiteral) > header->size)
+			return 0;
+
+		literal = (const TerpcLiteral *)(data + at);
+		at += sizeof(TerpcLiteral);
+
+		if (literal->node >= header->count)
+			return 0;
+
+		node = NODE(stmt, literal->node);
+
+		if (node->value.array != NULL)
+			return 0;
+
+		if (node->sType == sARRAY && literal->type == tSET && literal->kind <= eMASK) {
+			size = dataSize(literal->kind, literal->length);
+			if (at + size > header->size)
+				return 0;
+
+			value.value.array = newArray(literal->kind, literal->length);
+			memcpy(value.value.array->data, data + at, size);
+		} else if (node->sType == sBIG && literal->type == tBIG) {
+			size = literal->length * sizeof(uint32_t);
+			if (at + size > header->size)
+				return 0;
+
+			value.value.big = bigFromLimbs((const uint32_t *)(data + at), literal->length, literal->kind);
+		} else {
+			return 0;
+		}
+
+		value.type = literal->type;
+		node->value = value.value;
+		addLiteral(stmt, value);
+
+		at = ALIGN(at + size);
+	}
+
+	return 1;
+}
+
+int loadPrecompiled(const char *file, uint64_t hash, size_t size, Statement *stmt) {
+	const TerpcHeader *header;
+	struct stat info;
+	char *path = precompiledPath(file, hash), *data;
+	int fd = open(path, O_RDONLY);
+
+	free(path);
+
+	if (fd < 0)
+		return 0;
+
+	if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(TerpcHeader)) {
+		close(fd);
+		return 0;
+	}
+
+	// private and writable: resolveStatement() fills in slots, which only copies the pages it
+	// touches, and the file itself never changes
+	data = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return 0;
+
+	if (!valid(data, info.st_size, hash, size)) {
+		munmap(data, info.st_size);
+		return 0;
+	}
+
+	header = (const TerpcHeader *)data;
+
+	// from here on resetStatement() unmaps it
+	stmt->mapping = data;
+	stmt->mappingSize = info.st_size;
+
+	stmt->nodes = (ParseNode *)(data + header->nodes);
+	stmt->count = stmt->capacity = header->count;
+	stmt->roots = (NodeId *)(data + header->roots);
+	stmt->rootCount = stmt->rootCapacity = header->rootCount;
+	stmt->names = data + header->names;
+	stmt->namesLength = stmt->namesCapacity = header->namesLength;
+
+	if (!loadLiterals(stmt, data, header)) {
+		resetStatement(stmt);
+		return 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,68 @@
+#ifndef __TERPC_H__
+#define __TERPC_H__
+
+#include "stmt.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A .terpc file is a parsed (and folded, but not resolved) script's Statement written out as
+// is: the node array, roots and name pool go in unchanged so they can be used straight out of
+// the mapped file, followed by the array and big integer literals, which are rebuilt.
+// It's written next to the script (foo.terp -> foo.terpc) or, if TERP_CACHE_DIR is set, into
+// that directory named after the source's hash.
+#define TERPC_MAGIC "terpc"
+
+// bump when the encoding changes; the node size and number of statement types are checked
+// too, so a terp whose ParseNode is laid out differently won't trust the file
+#define TERPC_VERSION 1
+
+typedef struct tagTerpcHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint32_t nodeSize;
+	uint32_t stmtTypes;
+
+	// the script it was made from
+	uint64_t sourceHash;
+	uint64_t sourceSize;
+
+	// size of the whole file, and sourceHash() of everything after this header, which catches
+	// damage the structural checks can't (a changed number, say)
+	uint64_t size;
+	uint64_t checksum;
+
+	uint32_t count;
+	uint32_t rootCount;
+	uint32_t namesLength;
+	uint32_t literalCount;
+
+	// offsets of each section
+	uint64_t nodes;
+	uint64_t roots;
+	uint64_t names;
+	uint64_t literals;
+} TerpcHeader;
+
+// each literal is one of these followed by its elements or limbs
+typedef struct tagTerpcLiteral {
+	uint32_t node;
+	uint32_t type;
+
+	// ElemType for arrays, sign for big integers
+	uint32_t kind;
+	uint32_t length;
+} TerpcLiteral;
+
+// Hash of a script's source, taken before the scanner gets to it
+uint64_t sourceHash(const char *source, size_t size);
+
+// Fill a (reset) stmt from the script's .terpc file, if there is one matching this source and
+// this terp. Returns 0 if there isn't (or it's damaged), and stmt is left empty to be parsed.
+int loadPrecompiled(const char *file, uint64_t hash, size_t size, Statement *stmt);
+
+// Write a freshly parsed stmt out for next time. Failing just means the next run parses again.
+void savePrecompiled(const char *file, uint64_t hash, size_t size, Statement *stmt);
+
+#endif
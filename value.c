@@ -0,0 +1,280 @@
+#include "value.h"
+#include "stmt.h"
+#include "terp.h"
+#include "array.h"
+#include "bigint.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int64_t integerOf(Element e) {
+	return e.type == tBOOL ? e.value.boolean : e.value.integer;
+}
+
+double realOf(Element e) {
+	switch(e.type) {
+	case tREAL:
+		return e.value.real;
+	case tBIG:
+		return bigToDouble(e.value.big);
+	default:
+		return (double)integerOf(e);
+	}
+}
+
+Element arithmetic(State *state, ArithOp op, Element left, Element right) {
+	Element result;
+	int64_t a, b, c;
+
+	// nil is contagious
+	if (left.type == tNIL || right.type == tNIL)
+		return NIL;
+
+	if (left.type == tSET || right.type == tSET)
+		return arrayArithmetic(state, op, left, right);
+
+	if (left.type == tREAL || right.type == tREAL) {
+		result.type = tREAL;
+
+		switch(op) {
+		case aPLUS:
+			result.value.real = realOf(left) + realOf(right);
+			return result;
+		case aSUB:
+			result.value.real = realOf(left) - realOf(right);
+			return result;
+		case aMULT:
+			result.value.real = realOf(left) * realOf(right);
+			return result;
+		case aDIV:
+			if (realOf(right) == 0) {
+				error(state, "Division by zero");
+				return NIL;
+			}
+
+			result.value.real = realOf(left) / realOf(right);
+			return result;
+		default:
+			error(state, "Unknown arithmetic operation");
+			return NIL;
+		}
+	}
+
+	if (left.type == tBIG || right.type == tBIG)
+		return bigArithmetic(state, op, left, right);
+
+	// the usual case: both fit in 64 bits, and so (usually) does the result
+	a = integerOf(left);
+	b = integerOf(right);
+	result.type = tINT;
+
+	switch(op) {
+	case aPLUS:
+		if (__builtin_add_overflow(a, b, &c))
+			break;
+
+		result.value.integer = c;
+		return result;
+	case aSUB:
+		if (__builtin_sub_overflow(a, b, &c))
+			break;
+
+		result.value.integer = c;
+		return result;
+	case aMULT:
+		if (__builtin_mul_overflow(a, b, &c))
+			break;
+
+		result.value.integer = c;
+		return result;
+	case aDIV:
+		if (b == 0) {
+			error(state, "Division by zero");
+			return NIL;
+		}
+
+		// INT64_MIN / -1 is the one quotient that doesn't fit
+		if (a == INT64_MIN && b == -1)
+			break;
+
+		result.value.integer = a / b;
+		return result;
+	default:
+		error(state, "Unknown arithmetic operation");
+		return NIL;
+	}
+
+	// overflowed, do it again with big integers
+	return bigArithmetic(state, op, left, right);
+}
+
+Element compare(State *state, BoolOp op, Element left, Element right) {
+	Element result;
+	int64_t a, b;
+
+	if (left.type == tNIL || right.type == tNIL)
+		return NIL;
+
+	if (left.type == tSET || right.type == tSET)
+		return arrayCompare(state, op, left, right);
+
+	result.type = tBOOL;
+
+	if (left.type == tREAL || right.type == tREAL) {
+		switch(op) {
+		case bLESSTHAN:
+			result.value.boolean = realOf(left) < realOf(right);
+			return result;
+		case bGREATERTHAN:
+			result.value.boolean = realOf(left) > realOf(right);
+			return result;
+		case bEQUALTO:
+			result.value.boolean = realOf(left) == realOf(right);
+			return result;
+		default:
+			error(state, "Unknown boolean operation");
+			return NIL;
+		}
+	}
+
+	if (left.type == tBIG || right.type == tBIG)
+		return bigCompare(state, op, left, right);
+
+	a = integerOf(left);
+	b = integerOf(right);
+
+	switch(op) {
+	case bLESSTHAN:
+		result.value.boolean = a < b;
+		return result;
+	case bGREATERTHAN:
+		result.value.boolean = a > b;
+		return result;
+	case bEQUALTO:
+		result.value.boolean = a == b;
+		return result;
+	default:
+		error(state, "Unknown boolean operation");
+		return NIL;
+	}
+}
+
+int isTrue(Element condition) {
+	if (condition.type == tSET)
+		return arrayAll(condition.value.array);
+
+	return condition.value.boolean;
+}
+
+Element copyValue(State *state, Element e) {
+	switch(e.type) {
+	case tSET:
+		e.value.array = copyArray(e.value.array);
+		return keepValue(state, e);
+	case tBIG:
+		e.value.big = copyBig(e.value.big);
+		return keepValue(state, e);
+	default:
+		return e;
+	}
+}
+
+void freeValue(Element e) {
+	switch(e.type) {
+	case tSET:
+		freeArray(e.value.array);
+		break;
+	case tBIG:
+		freeBig(e.value.big);
+		break;
+	default:
+		break;
+	}
+}
+
+size_t valueSize(Element e) {
+	switch(e.type) {
+	case tSET:
+		return sizeof(Array) + dataSize(e.value.array->type, e.value.array->capacity);
+	case tBIG:
+		return sizeof(BigInt) + e.value.big->length * sizeof(uint32_t);
+	default:
+		return 0;
+	}
+}
+
+// shortest form that reads back as the same double, always with a decimal point
+static char *formatReal(char *buffer, size_t size, double real) {
+	snprintf(buffer, size, "%.15g", real);
+	if (strtod(buffer, NULL) != real)
+		snprintf(buffer, size, "%.17g", real);
+
+	if (strspn(buffer, "-0123456789") == strlen(buffer))
+		strcat(buffer, ".0");
+
+	return buffer;
+}
+
+static void printArray(FILE *out, Array *array) {
+	char buffer[32];
+	int i;
+
+	fprintf(out, "[");
+
+	for (i = 0; i < array->length; i++) {
+		if (i > 0)
+			fprintf(out, ", ");
+
+		switch(array->type) {
+		case eINT32:
+			fprintf(out, "%d", ((int32_t *)array->data)[i]);
+			break;
+		case eINT64:
+			fprintf(out, "%lld", (long long)((int64_t *)array->data)[i]);
+			break;
+		case eREAL:
+			fprintf(out, "%s", formatReal(buffer, sizeof buffer, ((double *)array->data)[i]));
+			break;
+		case eMASK:
+			fprintf(out, "%s", MASK_BIT(array, i) ? "true" : "false");
+			break;
+		}
+	}
+
+	fprintf(out, "]");
+}
+
+void printValue(FILE *out, Element e) {
+	char buffer[32], *digits;
+
+	switch(e.type) {
+	case tNIL:
+		fprintf(out, "nil");
+		break;
+	case tINT:
+		fprintf(out, "%lld", (long long)e.value.integer);
+		break;
+	case tBIG:
+		digits = bigToString(e.value.big);
+		fprintf(out, "%s", digits);
+		free(digits);
+		break;
+	case tREAL:
+		fprintf(out, "%s", formatReal(buffer, sizeof buffer, e.value.real));
+		break;
+	case tSET:
+		printArray(out, e.value.array);
+		break;
+	case tSTR:
+		fprintf(out, "%s", e.value.string);
+		break;
+	case tBOOL:
+		fprintf(out, "%s", e.value.boolean ? "true" : "false");
+		break;
+	default:
+		fprintf(out, "Error, could not identify return type");
+		break;
+	}
+}
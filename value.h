@@ -0,0 +1,36 @@
+#ifndef __VALUE_H__
+#define __VALUE_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Apply an arithmetic operator to two values. Integers (and booleans) stay integers unless the
+// other side is real, becoming big integers only when a result doesn't fit in 64 bits; arrays
+// work elementwise. Nil operands give nil, as does division by zero (after reporting it).
+// New big integers and arrays are owned by state, or by the caller if state is NULL.
+Element arithmetic(State *state, ArithOp op, Element left, Element right);
+
+// Compare two numbers (or arrays, giving a mask), nil operands give nil
+Element compare(State *state, BoolOp op, Element left, Element right);
+
+// Whether a (non-nil) if condition holds; an array condition needs every element to
+int isTrue(Element condition);
+
+// A number as an integer (booleans are 0/1) or as a double
+int64_t integerOf(Element e);
+double realOf(Element e);
+
+// Write a value the way the REPL shows it (without the ": " in front)
+void printValue(FILE *out, Element e);
+
+// Values that own memory (arrays, big integers): a copy for state to own, and freeing one
+Element copyValue(State *state, Element e);
+void freeValue(Element e);
+
+// The bytes one of those takes up, 0 for anything else
+size_t valueSize(Element e);
+
+#endif
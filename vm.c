@@ -0,0 +1,768 @@
+#include "vm.h"
+#include "stmt.h"
+#include "terp.h"
+#include "value.h"
+#include "stats.h"
+#include "jit.h"
+#include "reactive.h"
+#include "function.h"
+#include "loop.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// operand stacks up to this deep live on the C stack
+#define SMALL_STACK 64
+
+// a node compileTree() is part way through: how far, and where its jumps are
+typedef struct tagCompileTask {
+	NodeId id;
+	int step;
+	int test;
+	int skip;
+} CompileTask;
+
+typedef struct tagCompiler {
+	Statement *stmt;
+	Chunk *chunk;
+	int depth;
+
+	CompileTask *tasks;
+	int taskCount;
+	int taskCapacity;
+
+	// for reporting errors
+	State *state;
+} Compiler;
+
+static int emit(Chunk *chunk, int word) {
+	if (chunk->count == chunk->capacity) {
+		chunk->capacity = chunk->capacity ? chunk->capacity * 2 : 16;
+		chunk->code = realloc(chunk->code, chunk->capacity * sizeof(int));
+	}
+
+	chunk->code[chunk->count] = word;
+	return chunk->count++;
+}
+
+static int addConstant(Chunk *chunk, Element value) {
+	if (chunk->constCount == chunk->constCapacity) {
+		chunk->constCapacity = chunk->constCapacity ? chunk->constCapacity * 2 : 4;
+		chunk->constants = realloc(chunk->constants, chunk->constCapacity * sizeof(Element));
+	}
+
+	chunk->constants[chunk->constCount] = value;
+	return chunk->constCount++;
+}
+
+// the chunk outlives the tree, so it keeps a definition of its own
+static int addDefinition(Chunk *chunk, Statement *stmt, NodeId def) {
+	Statement *definition = newStatement();
+
+	addRoot(definition, copySubtree(definition, stmt, def));
+
+	chunk->definitions = realloc(chunk->definitions, (chunk->definitionCount + 1) * sizeof(Statement *));
+	chunk->definitions[chunk->definitionCount] = definition;
+	return chunk->definitionCount++;
+}
+
+static int addReduction(Chunk *chunk, Reduction *plan) {
+	if (plan == NULL)
+		return -1;
+
+	chunk->reductions = realloc(chunk->reductions, (chunk->reductionCount + 1) * sizeof(Reduction *));
+	chunk->reductions[chunk->reductionCount] = plan;
+	return chunk->reductionCount++;
+}
+
+// track operand stack depth so execute() can size its stack up front
+static void push(Compiler *c, int n) {
+	c->depth += n;
+	if (c->depth > c->chunk->maxStack)
+		c->chunk->maxStack = c->depth;
+}
+
+static int arithOpCode(ArithOp op) {
+	switch(op) {
+	case aPLUS:
+		return OP_ADD;
+	case aSUB:
+		return OP_SUB;
+	case aMULT:
+		return OP_MULT;
+	case aDIV:
+		return OP_DIV;
+	default:
+		return -1;
+	}
+}
+
+static int boolOpCode(BoolOp op) {
+	switch(op) {
+	case bLESSTHAN:
+		return OP_LESSTHAN;
+	case bGREATERTHAN:
+		return OP_GREATERTHAN;
+	case bEQUALTO:
+		return OP_EQUALTO;
+	default:
+		return -1;
+	}
+}
+
+// assign top of stack to a variable or parameter
+static void emitStore(Compiler *c, ParseNode *var) {
+	if (var->sType == sPARAM)
+		emit(c->chunk, OP_STORE_PARAM);
+	else
+		emit(c->chunk, c->state != NULL && c->state->reactive ? OP_STORE_REACTIVE : OP_STORE);
+
+	emit(c->chunk, var->slot);
+}
+
+static void pushTask(Compiler *c, NodeId id) {
+	if (c->taskCount == c->taskCapacity) {
+		c->taskCapacity = c->taskCapacity ? c->taskCapacity * 2 : 16;
+		c->tasks = realloc(c->tasks, c->taskCapacity * sizeof(CompileTask));
+	}
+
+	c->tasks[c->taskCount].id = id;
+	c->tasks[c->taskCount++].step = 0;
+}
+
+// Every node leaves exactly one value on the stack. Nodes are worked through on a stack of our
+// own rather than by recursing, each one emitting its code a step at a time between its
+// children's.
+static int compileTree(Compiler *c, NodeId root) {
+	Chunk *chunk = c->chunk;
+	CompileTask *task;
+	ParseNode *node;
+	Element constant;
+	int op;
+
+	pushTask(c, root);
+
+	while (c->taskCount > 0) {
+		task = &c->tasks[c->taskCount - 1];
+		node = NODE(c->stmt, task->id);
+
+		switch(node->sType) {
+		case sASSIGN:
+			if (task->step++ == 0) {
+				pushTask(c, node->children[1]);
+				break;
+			}
+
+			emitStore(c, NODE(c->stmt, node->children[0]));
+			c->taskCount--;
+			break;
+		case sIF:
+		case sIFELSE:
+			// cond; TEST nil,else; true; JUMP end; [else: false; JUMP end;] nil: NIL; end:
+			switch(task->step++) {
+			case 0:
+				pushTask(c, node->children[0]);
+				break;
+			case 1:
+				task->test = emit(chunk, OP_TEST);
+				emit(chunk, 0);
+				emit(chunk, 0);
+				push(c, -1);
+
+				pushTask(c, node->children[1]);
+				break;
+			case 2:
+				task->skip = emit(chunk, OP_JUMP);
+				emit(chunk, 0);
+
+				// only one of the branches leaves its value behind
+				push(c, -1);
+
+				if (node->sType == sIFELSE) {
+					chunk->code[task->test + 2] = chunk->count;
+					pushTask(c, node->children[2]);
+					break;
+				}
+
+				// fall through, there's no else branch
+			default:
+				if (node->sType == sIFELSE) {
+					emit(chunk, OP_JUMP);
+					emit(chunk, chunk->count + 2);
+					push(c, -1);
+				}
+
+				// condition was nil (or false without an else branch)
+				chunk->code[task->test + 1] = chunk->count;
+				if (node->sType == sIF)
+					chunk->code[task->test + 2] = chunk->count;
+
+				emit(chunk, OP_NIL);
+				push(c, 1);
+
+				chunk->code[task->skip + 1] = chunk->count;
+				c->taskCount--;
+				break;
+			}
+			break;
+		case sBOOLVAL:
+			constant.type = tBOOL;
+			constant.value.boolean = node->value.boolean;
+
+			emit(chunk, OP_CONST);
+			emit(chunk, addConstant(chunk, constant));
+			push(c, 1);
+			c->taskCount--;
+			break;
+		case sBOOL:
+		case sARITH:
+			op = node->sType == sBOOL ? boolOpCode(node->op.boolop) : arithOpCode(node->op.arithop);
+
+			if (op < 0) {
+				error(c->state, node->sType == sBOOL ? "Unknown boolean operation" : "Unknown arithmetic operation");
+				return 0;
+			}
+
+			// both sides, then the operation
+			if (task->step < 2) {
+				pushTask(c, node->children[task->step++]);
+				break;
+			}
+
+			emit(chunk, op);
+			push(c, -1);
+			c->taskCount--;
+			break;
+		case sNIL:
+			emit(chunk, OP_NIL);
+			push(c, 1);
+			c->taskCount--;
+			break;
+		case sARRAY:
+		case sBIG:
+			// the constant still belongs to the statement, so it's copied every time it runs
+			constant.type = node->vType;
+			constant.value = node->value;
+
+			emit(chunk, OP_COPY);
+			emit(chunk, addConstant(chunk, constant));
+			push(c, 1);
+			c->taskCount--;
+			break;
+		case sINT:
+		case sREAL:
+			constant.type = node->vType;
+			constant.value = node->value;
+
+			emit(chunk, OP_CONST);
+			emit(chunk, addConstant(chunk, constant));
+			push(c, 1);
+			c->taskCount--;
+			break;
+		case sVAR:
+			emit(chunk, c->state != NULL && c->state->reactive ? OP_LOAD_REACTIVE : OP_LOAD);
+			emit(chunk, node->slot);
+			push(c, 1);
+			c->taskCount--;
+			break;
+		case sPARAM:
+			emit(chunk, OP_PARAM);
+			emit(chunk, node->slot);
+			push(c, 1);
+			c->taskCount--;
+			break;
+		case sDEF:
+			emit(chunk, OP_DEFINE);
+			emit(chunk, addDefinition(chunk, c->stmt, task->id));
+			push(c, 1);
+			c->taskCount--;
+			break;
+		case sLIST:
+			// each item leaves its value for the call, the rest of the list takes its place
+			if (task->step++ == 0) {
+				pushTask(c, node->children[0]);
+				break;
+			}
+
+			c->taskCount--;
+
+			if (NODE(c->stmt, node->children[1])->sType == sLIST)
+				pushTask(c, node->children[1]);
+			break;
+		case sCALL:
+			// the arguments, left to right, then the call on them
+			if (task->step++ == 0 && NODE(c->stmt, node->children[0])->sType == sLIST) {
+				pushTask(c, node->children[0]);
+				break;
+			}
+
+			emit(chunk, OP_CALL);
+			emit(chunk, node->slot);
+			emit(chunk, (int)node->value.integer);
+			push(c, 1 - (int)node->value.integer);
+			c->taskCount--;
+			break;
+		case sFOR:
+			// from; to; FOR end,reduction; top: COUNTER; STORE var; body; NEXT top; end:
+			switch(task->step++) {
+			case 0:
+			case 1:
+				pushTask(c, node->children[task->step]);
+				break;
+			case 2:
+				task->test = emit(chunk, OP_FOR);
+				emit(chunk, 0);
+				emit(chunk, addReduction(chunk, planReduction(c->stmt, task->id)));
+				push(c, 2);
+
+				task->skip = emit(chunk, OP_COUNTER);
+				push(c, 1);
+				emitStore(c, NODE(c->stmt, node->children[0]));
+
+				pushTask(c, node->children[3]);
+				break;
+			default:
+				emit(chunk, OP_NEXT);
+				emit(chunk, task->skip);
+				push(c, -5);
+
+				chunk->code[task->test + 1] = chunk->count;
+				c->taskCount--;
+				break;
+			}
+			break;
+		default:
+			error(c->state, "Fatal: unknown statement type");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+Chunk *compile(Statement *stmt, NodeId root, State *state) {
+	STAT_CLOCK(start);
+	Compiler c;
+	Chunk *chunk = calloc(1, sizeof(Chunk));
+
+	c.stmt = stmt;
+	c.chunk = chunk;
+	c.depth = 0;
+	c.tasks = NULL;
+	c.taskCount = c.taskCapacity = 0;
+	c.state = state;
+
+	if (!compileTree(&c, root)) {
+		freeChunk(chunk);
+		chunk = NULL;
+	} else {
+		emit(chunk, OP_RETURN);
+	}
+
+	free(c.tasks);
+
+	STAT_ELAPSED(compileTime, start);
+
+	return chunk;
+}
+
+static ArithOp arithOf(int op) {
+	switch(op) {
+	case OP_SUB:
+		return aSUB;
+	case OP_MULT:
+		return aMULT;
+	case OP_DIV:
+		return aDIV;
+	default:
+		return aPLUS;
+	}
+}
+
+static BoolOp boolOf(int op) {
+	switch(op) {
+	case OP_GREATERTHAN:
+		return bGREATERTHAN;
+	case OP_EQUALTO:
+		return bEQUALTO;
+	default:
+		return bLESSTHAN;
+	}
+}
+
+// the specialized form of a generic instruction for these operand types (or the instruction itself)
+static int quicken(int op, ValueType left, ValueType right) {
+	int ints = left == tINT && right == tINT;
+	int reals = left == tREAL && right == tREAL;
+
+	switch(op) {
+	case OP_ADD:
+		return ints ? OP_ADD_II : reals ? OP_ADD_RR : op;
+	case OP_SUB:
+		return ints ? OP_SUB_II : reals ? OP_SUB_RR : op;
+	case OP_MULT:
+		return ints ? OP_MULT_II : reals ? OP_MULT_RR : op;
+	case OP_DIV:
+		return ints ? OP_DIV_II : reals ? OP_DIV_RR : op;
+	case OP_LESSTHAN:
+		return ints ? OP_LESSTHAN_II : reals ? OP_LESSTHAN_RR : op;
+	case OP_GREATERTHAN:
+		return ints ? OP_GREATERTHAN_II : reals ? OP_GREATERTHAN_RR : op;
+	case OP_EQUALTO:
+		return ints ? OP_EQUALTO_II : reals ? OP_EQUALTO_RR : op;
+	case OP_LOAD:
+		return left == tINT ? OP_LOAD_INT : left == tREAL ? OP_LOAD_REAL : op;
+	default:
+		return op;
+	}
+}
+
+static int generic(int op) {
+	switch(op) {
+	case OP_LOAD_INT:
+	case OP_LOAD_REAL:
+		return OP_LOAD;
+	case OP_ADD_II:
+	case OP_ADD_RR:
+		return OP_ADD;
+	case OP_SUB_II:
+	case OP_SUB_RR:
+		return OP_SUB;
+	case OP_MULT_II:
+	case OP_MULT_RR:
+		return OP_MULT;
+	case OP_DIV_II:
+	case OP_DIV_RR:
+		return OP_DIV;
+	case OP_LESSTHAN_II:
+	case OP_LESSTHAN_RR:
+		return OP_LESSTHAN;
+	case OP_GREATERTHAN_II:
+	case OP_GREATERTHAN_RR:
+		return OP_GREATERTHAN;
+	case OP_EQUALTO_II:
+	case OP_EQUALTO_RR:
+		return OP_EQUALTO;
+	default:
+		return op;
+	}
+}
+
+#define BOTH(t) (sp[-2].type == (t) && sp[-1].type == (t))
+
+// integer ops overflow into big integers, the same as arithmetic() does
+#define INT_OP(builtin, arithop) \
+	sp--; \
+	if (builtin(sp[-1].value.integer, sp->value.integer, &n)) \
+		sp[-1] = arithmetic(state, arithop, sp[-1], *sp); \
+	else \
+		sp[-1].value.integer = n
+
+Element execute(Chunk *chunk, State *state) {
+	Element small[SMALL_STACK];
+	Element *stack = small, *sp;
+	Element result;
+	int *ip = chunk->code;
+	int op;
+	int64_t n;
+	Slot *slot;
+
+	if (chunk->maxStack > SMALL_STACK)
+		stack = malloc(chunk->maxStack * sizeof(Element));
+	sp = stack;
+
+	STAT_INC(executions);
+	if (stack != small)
+		STAT_INC(stackAllocs);
+
+	for (;;) {
+		STAT_INC(instructions);
+
+		switch(op = *ip++) {
+		case OP_NIL:
+			sp->type = tNIL;
+			sp++;
+			break;
+		case OP_CONST:
+			*sp++ = chunk->constants[*ip++];
+			break;
+		case OP_COPY:
+			*sp++ = copyValue(state, chunk->constants[*ip++]);
+			break;
+		case OP_LOAD:
+			slot = &state->slots[*ip];
+
+			if (!slot->defined) {
+				error(state, "Variable doesn't exist");
+				sp->type = tNIL;
+			} else {
+				*sp = slot->value;
+
+				if (chunk->deopts < MAX_DEOPTS)
+					ip[-1] = quicken(op, sp->type, tNIL);
+			}
+			ip++;
+			sp++;
+			break;
+		case OP_LOAD_INT:
+		case OP_LOAD_REAL:
+			// an undefined slot holds nil, so checking the type is enough
+			slot = &state->slots[*ip];
+
+			if (slot->value.type != (op == OP_LOAD_INT ? tINT : tREAL))
+				goto deopt;
+
+			*sp++ = slot->value;
+			ip++;
+			break;
+		case OP_STORE:
+			slot = &state->slots[*ip++];
+			slot->value = sp[-1];
+			slot->defined = 1;
+			break;
+		case OP_LOAD_REACTIVE:
+			slot = &state->slots[*ip];
+
+			if (slot->cell != NULL && slot->cell->dirty)
+				refreshSlot(state, *ip);
+
+			if (!slot->defined) {
+				error(state, "Variable doesn't exist");
+				sp->type = tNIL;
+			} else {
+				*sp = slot->value;
+			}
+			ip++;
+			sp++;
+			break;
+		case OP_STORE_REACTIVE:
+			slot = &state->slots[*ip];
+			slot->value = sp[-1];
+			slot->defined = 1;
+
+			slotAssigned(state, *ip++);
+			break;
+		case OP_ADD:
+		case OP_SUB:
+		case OP_MULT:
+		case OP_DIV:
+			sp--;
+
+			if (chunk->deopts < MAX_DEOPTS)
+				ip[-1] = quicken(op, sp[-1].type, sp->type);
+
+			sp[-1] = arithmetic(state, arithOf(op), sp[-1], *sp);
+			break;
+		case OP_ADD_II:
+			if (!BOTH(tINT))
+				goto deopt;
+			INT_OP(__builtin_add_overflow, aPLUS);
+			break;
+		case OP_SUB_II:
+			if (!BOTH(tINT))
+				goto deopt;
+			INT_OP(__builtin_sub_overflow, aSUB);
+			break;
+		case OP_MULT_II:
+			if (!BOTH(tINT))
+				goto deopt;
+			INT_OP(__builtin_mul_overflow, aMULT);
+			break;
+		case OP_DIV_II:
+			if (!BOTH(tINT))
+				goto deopt;
+
+			sp--;
+
+			// let arithmetic() deal with (and report) the awkward divisors
+			if (sp->value.integer == 0 || sp->value.integer == -1)
+				sp[-1] = arithmetic(state, aDIV, sp[-1], *sp);
+			else
+				sp[-1].value.integer /= sp->value.integer;
+			break;
+		case OP_ADD_RR:
+			if (!BOTH(tREAL))
+				goto deopt;
+			sp--;
+			sp[-1].value.real += sp->value.real;
+			break;
+		case OP_SUB_RR:
+			if (!BOTH(tREAL))
+				goto deopt;
+			sp--;
+			sp[-1].value.real -= sp->value.real;
+			break;
+		case OP_MULT_RR:
+			if (!BOTH(tREAL))
+				goto deopt;
+			sp--;
+			sp[-1].value.real *= sp->value.real;
+			break;
+		case OP_DIV_RR:
+			if (!BOTH(tREAL))
+				goto deopt;
+
+			sp--;
+
+			if (sp->value.real == 0)
+				sp[-1] = arithmetic(state, aDIV, sp[-1], *sp);
+			else
+				sp[-1].value.real /= sp->value.real;
+			break;
+		case OP_LESSTHAN:
+		case OP_GREATERTHAN:
+		case OP_EQUALTO:
+			sp--;
+
+			if (chunk->deopts < MAX_DEOPTS)
+				ip[-1] = quicken(op, sp[-1].type, sp->type);
+
+			sp[-1] = compare(state, boolOf(op), sp[-1], *sp);
+			break;
+		case OP_LESSTHAN_II:
+		case OP_GREATERTHAN_II:
+		case OP_EQUALTO_II:
+			if (!BOTH(tINT))
+				goto deopt;
+
+			sp--;
+			sp[-1].type = tBOOL;
+			sp[-1].value.boolean = op == OP_LESSTHAN_II ? sp[-1].value.integer < sp->value.integer
+				: op == OP_GREATERTHAN_II ? sp[-1].value.integer > sp->value.integer
+				: sp[-1].value.integer == sp->value.integer;
+			break;
+		case OP_LESSTHAN_RR:
+		case OP_GREATERTHAN_RR:
+		case OP_EQUALTO_RR:
+			if (!BOTH(tREAL))
+				goto deopt;
+
+			sp--;
+			sp[-1].type = tBOOL;
+			sp[-1].value.boolean = op == OP_LESSTHAN_RR ? sp[-1].value.real < sp->value.real
+				: op == OP_GREATERTHAN_RR ? sp[-1].value.real > sp->value.real
+				: sp[-1].value.real == sp->value.real;
+			break;
+		case OP_TEST:
+			sp--;
+
+			if (sp->type == tNIL)
+				ip = chunk->code + ip[0];
+			else if (!isTrue(*sp))
+				ip = chunk->code + ip[1];
+			else
+				ip += 2;
+			break;
+		case OP_JUMP:
+			ip = chunk->code + *ip;
+			break;
+		case OP_PARAM:
+			*sp++ = state->frame[*ip++];
+			break;
+		case OP_STORE_PARAM:
+			state->frame[*ip++] = sp[-1];
+			break;
+		case OP_CALL:
+			// the arguments are the callee's frame, its value takes their place
+			sp -= ip[1];
+			*sp = callFunction(state, ip[0], sp, ip[1]);
+			sp++;
+			ip += 2;
+			break;
+		case OP_DEFINE:
+			defineFunction(state, chunk->definitions[*ip], chunk->definitions[*ip]->roots[0]);
+			ip++;
+
+			sp->type = tNIL;
+			sp++;
+			break;
+		case OP_FOR:
+			if (!loopBounds(state, sp[-2], sp[-1])) {
+				sp--;
+				sp[-1].type = tNIL;
+				ip = chunk->code + ip[0];
+				break;
+			}
+
+			// where the heap was, then the body's latest value
+			sp->type = tINT;
+			sp->value.integer = state->heapCount;
+			sp[1].type = tNIL;
+			sp += 2;
+
+			if (ip[1] >= 0 && worthReducing(state, sp[-4].value.integer, sp[-3].value.integer)
+				&& runReduction(chunk->reductions[ip[1]], state, &sp[-4].value.integer, sp[-3].value.integer, &sp[-1])) {
+				sp -= 3;
+				sp[-1] = sp[2];
+				ip = chunk->code + ip[0];
+				break;
+			}
+
+			ip += 2;
+			break;
+		case OP_COUNTER:
+			*sp = sp[-4];
+			sp++;
+			break;
+		case OP_NEXT:
+			sp -= 2;
+			sp[-1] = sp[1];
+
+			if (sp[-4].value.integer == sp[-3].value.integer) {
+				sp -= 3;
+				sp[-1] = sp[2];
+				ip++;
+			} else {
+				if (COLLECTION_DUE(state))
+					collectLoopGarbage(state, (int)sp[-2].value.integer, sp[-1]);
+				sp[-4].value.integer++;
+				ip = chunk->code + *ip;
+			}
+			break;
+		case OP_RETURN:
+			result = sp[-1];
+
+			if (stack != small)
+				free(stack);
+
+			return result;
+		default:
+			error(state, "Fatal: unknown instruction");
+
+			if (stack != small)
+				free(stack);
+
+			return NIL;
+		}
+
+		continue;
+
+deopt:
+		// a quickened instruction's guess was wrong: put the generic one back and run that
+		ip[-1] = generic(op);
+		ip--;
+		chunk->deopts++;
+		STAT_INC(deopts);
+	}
+}
+
+void freeChunk(Chunk *chunk) {
+	int i;
+
+	if (chunk == NULL)
+		return;
+
+	for (i = 0; i < chunk->definitionCount; i++)
+		deleteStatement(chunk->definitions[i]);
+	free(chunk->definitions);
+
+	for (i = 0; i < chunk->reductionCount; i++)
+		freeReduction(chunk->reductions[i]);
+	free(chunk->reductions);
+
+	jitFree(chunk->native);
+	free(chunk->constants);
+	free(chunk->code);
+	free(chunk);
+}
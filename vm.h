@@ -0,0 +1,106 @@
+#ifndef __VM_H__
+#define __VM_H__
+
+#include "stmt.h"
+#include "terp.h"
+
+// instructions are one word, optionally followed by inline operand words
+typedef enum tagOpCode {
+	OP_NIL,			// push nil
+	OP_CONST,		// push constants[a]
+	OP_LOAD,		// push the value of variable slot a
+	OP_STORE,		// assign top of stack to variable slot a (value stays on the stack)
+	OP_ADD,
+	OP_SUB,
+	OP_MULT,
+	OP_DIV,
+	OP_LESSTHAN,
+	OP_GREATERTHAN,
+	OP_EQUALTO,
+	OP_TEST,		// pop condition, jump to a if it is nil, to b if it is false
+	OP_JUMP,		// jump to a
+	OP_RETURN,		// pop and return the statement's value
+	OP_COPY,		// push a copy of constants[a], an array or big integer literal
+	OP_PARAM,		// push the called function's parameter a
+	OP_STORE_PARAM,		// assign top of stack to parameter a (value stays on the stack)
+	OP_CALL,		// call function a on the top b values, which its value replaces
+	OP_DEFINE,		// run definitions[a], push nil
+
+	// A loop keeps its counter, where it stops and the body's latest value on the stack.
+	// reductions[b] (if b isn't -1) runs what it can of it (see loop.h).
+	OP_FOR,			// start a loop on the two bounds on the stack, or jump to a with its value if there's nothing for the body to do
+	OP_COUNTER,		// push the loop's counter
+	OP_NEXT,		// pop the body's value, jump to a for the next iteration if there is one
+
+	// what loads and stores compile to in reactive mode (see reactive.h), never quickened
+	OP_LOAD_REACTIVE,	// OP_LOAD, recomputing the variable first if it's out of date
+	OP_STORE_REACTIVE,	// OP_STORE, then mark whatever depends on the variable out of date
+
+	// Quickened forms. A generic instruction rewrites itself into one of these after seeing
+	// its operand types; each one guards its assumption and turns back into the generic
+	// instruction (a deopt) when the guard fails.
+	OP_LOAD_INT,
+	OP_LOAD_REAL,
+	OP_ADD_II,
+	OP_SUB_II,
+	OP_MULT_II,
+	OP_DIV_II,
+	OP_ADD_RR,
+	OP_SUB_RR,
+	OP_MULT_RR,
+	OP_DIV_RR,
+	OP_LESSTHAN_II,
+	OP_GREATERTHAN_II,
+	OP_EQUALTO_II,
+	OP_LESSTHAN_RR,
+	OP_GREATERTHAN_RR,
+	OP_EQUALTO_RR
+} OpCode;
+
+// a chunk that has deoptimized this often stops quickening
+#define MAX_DEOPTS 8
+
+// a statement lowered to linear bytecode
+typedef struct tagChunk {
+	int *code;
+	int count;
+	int capacity;
+
+	Element *constants;
+	int constCount;
+	int constCapacity;
+
+	// the function definitions in the statement, copied out of it (see function.h)
+	Statement **definitions;
+	int definitionCount;
+
+	// the loops in the statement that can be run as reductions
+	struct tagReduction **reductions;
+	int reductionCount;
+
+	// deepest the operand stack gets while running the chunk
+	int maxStack;
+
+	// number of times a quickened instruction's guard has failed
+	int deopts;
+
+	// times the chunk has been run from the statement cache, and its native code
+	// once it has been run often enough (see jit.h)
+	int runs;
+	struct tagJitCode *native;
+
+	// times the native code has given up and left the statement to the VM
+	int bailouts;
+} Chunk;
+
+// Lower a resolved syntax tree to bytecode (the tree can be deleted afterwards,
+// but the chunk is tied to the State its slots came from)
+Chunk *compile(Statement *stmt, NodeId root, State *state);
+
+// Run a chunk to completion and return the statement's value
+Element execute(Chunk *chunk, State *state);
+
+// Delete a chunk (free from memory)
+void freeChunk(Chunk *chunk);
+
+#endif